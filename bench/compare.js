@@ -0,0 +1,104 @@
+// Compares the results of //:runtime_bench against a recorded baseline.
+//
+// Usage: node compare.js <results.json> <baseline.json> <thresholds.json>
+//   [--max_regression=<fraction>]
+//
+// A metric regresses when it is worse than the baseline by more than its
+// threshold: thresholds.metrics[<metric>], else --max_regression, else
+// thresholds.default. Exits with 1 if any metric regressed.
+'use strict';
+
+const fs = require('fs');
+
+// Metrics where a larger value is better; all others are latencies.
+const HIGHER_IS_BETTER = [
+  'callsPerSecond',
+  'messagesPerSecond',
+  'encodesPerSecond',
+  'decodesPerSecond',
+];
+
+const LOWER_IS_BETTER = [
+  'latencyMs.p50',
+  'latencyMs.p99',
+];
+
+function readJson(path) {
+  return JSON.parse(fs.readFileSync(path, 'utf8'));
+}
+
+function metricValue(result, metric) {
+  return metric.split('.').reduce(
+    (value, key) => value === undefined ? undefined : value[key], result);
+}
+
+// Results keyed by mode, serializer, service and method.
+function index(report) {
+  const results = new Map();
+  for (const run of report.runs) {
+    for (const result of run.results) {
+      const key = [run.mode, run.serializer, run.service, result.method]
+        .join(' ');
+      results.set(key, result);
+    }
+  }
+  return results;
+}
+
+function main(argv) {
+  const paths = argv.filter(arg => !arg.startsWith('--'));
+  if (paths.length !== 3) {
+    throw new Error('Expected <results.json> <baseline.json> <thresholds.json>');
+  }
+
+  const thresholds = readJson(paths[2]);
+  let fallback = thresholds.default;
+  for (const arg of argv) {
+    const match = /^--max_regression=(.*)$/.exec(arg);
+    if (match !== null) {
+      fallback = Number(match[1]);
+    }
+  }
+  const threshold = metric =>
+    thresholds.metrics && thresholds.metrics[metric] !== undefined ?
+      thresholds.metrics[metric] : fallback;
+
+  const results = index(readJson(paths[0]));
+  const baseline = index(readJson(paths[1]));
+  let regressions = 0;
+
+  for (const [key, before] of baseline) {
+    const after = results.get(key);
+    if (after === undefined) {
+      console.error('MISSING     ' + key);
+      regressions++;
+      continue;
+    }
+
+    const metrics = HIGHER_IS_BETTER.map(metric => [metric, 1])
+      .concat(LOWER_IS_BETTER.map(metric => [metric, -1]));
+    for (const [metric, direction] of metrics) {
+      const old = metricValue(before, metric);
+      const now = metricValue(after, metric);
+      if (typeof old !== 'number' || typeof now !== 'number' || old === 0) {
+        continue;
+      }
+
+      const change = (now - old) / old;
+      const limit = threshold(metric);
+      const regressed = -change * direction > limit;
+      if (regressed) {
+        regressions++;
+      }
+      console.error(
+        (regressed ? 'REGRESSION  ' : 'ok          ') + key + ' ' + metric +
+        ': ' + old.toFixed(2) + ' -> ' + now.toFixed(2) +
+        ' (' + (change >= 0 ? '+' : '') + (change * 100).toFixed(1) +
+        '%, limit ' + (limit * 100).toFixed(1) + '%)');
+    }
+  }
+
+  return regressions === 0 ? 0 : 1;
+}
+
+process.exit(main(process.argv.slice(2)));
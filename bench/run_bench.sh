@@ -0,0 +1,112 @@
+#!/bin/sh
+# Runtime benchmarks for the generated TypeScript, run with
+#
+#   bazel run //:runtime_bench -- [options]
+#
+# Generates bench/corpus with the `bench` option, type-checks and compiles
+# the output, then runs every generated bench twice: --codec=true over the
+# transformers and --loopback=true against an in-process server. Results
+# are written as JSON and, with --baseline, compared using thresholds.json
+# (see compare.js).
+#
+# Nothing is fetched. --node_modules must already contain typescript,
+# @types/node, the gRPC runtime of --target and the message runtime of
+# --serializer:
+#   google-protobuf: google-protobuf and ts-protoc-gen (for the typings)
+#   protobufjs:      protobufjs and its pbjs/pbts command line
+#
+# Options:
+#   --node_modules=<dir>        default: <workspace>/node_modules
+#   --output=<file>             default: <workspace>/bench_results.json
+#   --baseline=<file>           results to compare against
+#   --max_regression=<fraction> default for metrics thresholds.json omits
+#   --serializer=google-protobuf|protobufjs
+#   --target=grpc|grpc-js
+#   --duration=<seconds>        per method and mode, default 5
+#   --concurrency=<calls>       loopback calls in flight, default 16
+set -e
+
+workspace="${BUILD_WORKSPACE_DIRECTORY:-$(pwd)}"
+node_modules="$workspace/node_modules"
+output="$workspace/bench_results.json"
+baseline=""
+max_regression=""
+serializer="google-protobuf"
+target="grpc"
+duration=5
+concurrency=16
+
+absolute() {
+  case "$1" in
+    /*) echo "$1" ;;
+    *) echo "$2/$1" ;;
+  esac
+}
+
+for arg in "$@"; do
+  value="${arg#*=}"
+  case "$arg" in
+    --protoc=*) protoc=$(absolute "$value" "$(pwd)") ;;
+    --plugin=*) plugin=$(absolute "$value" "$(pwd)") ;;
+    --corpus=*) corpus=$(absolute "$value" "$(pwd)") ;;
+    --compare=*) compare=$(absolute "$value" "$(pwd)") ;;
+    --thresholds=*) thresholds=$(absolute "$value" "$(pwd)") ;;
+    --node_modules=*) node_modules=$(absolute "$value" "$workspace") ;;
+    --output=*) output=$(absolute "$value" "$workspace") ;;
+    --baseline=*) baseline=$(absolute "$value" "$workspace") ;;
+    --max_regression=*) max_regression="$arg" ;;
+    --serializer=*) serializer="$value" ;;
+    --target=*) target="$value" ;;
+    --duration=*) duration="$value" ;;
+    --concurrency=*) concurrency="$value" ;;
+    *) echo "runtime_bench: unknown option $arg" >&2; exit 2 ;;
+  esac
+done
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+corpus_dir=$(dirname "$corpus")
+ln -s "$node_modules" "$work/node_modules"
+bin="$node_modules/.bin"
+
+case "$serializer" in
+  google-protobuf)
+    "$protoc" -I"$corpus_dir" \
+      --js_out=import_style=commonjs,binary:"$work" \
+      --plugin=protoc-gen-ts="$bin/protoc-gen-ts" --ts_out="$work" \
+      "$corpus"
+    ;;
+  protobufjs)
+    module="$work/$(basename "$corpus" .proto)_pbjs.js"
+    "$bin/pbjs" -t static-module -w commonjs -o "$module" "$corpus"
+    "$bin/pbts" -o "${module%.js}.d.ts" "$module"
+    ;;
+  *)
+    echo "runtime_bench: unknown serializer $serializer" >&2
+    exit 2
+    ;;
+esac
+
+"$protoc" -I"$corpus_dir" \
+  --plugin=protoc-gen-grpc-node="$plugin" \
+  --grpc-node_out=bench,serializer="$serializer",target="$target":"$work" \
+  "$corpus"
+
+"$bin/tsc" --module commonjs --target es2017 --skipLibCheck \
+  --types node "$work"/*_grpc_pb.ts "$work"/*_grpc_bench.ts
+
+runs=""
+for bench in "$work"/*_grpc_bench.js; do
+  for mode in --codec=true --loopback=true; do
+    result=$(node "$bench" "$mode" --duration="$duration" \
+      --concurrency="$concurrency")
+    runs="${runs:+$runs,
+}$result"
+  done
+done
+printf '{\n"runs": [\n%s\n]\n}\n' "$runs" > "$output"
+echo "runtime_bench: results written to $output" >&2
+
+if [ -n "$baseline" ]; then
+  node "$compare" "$output" "$baseline" "$thresholds" $max_regression
+fi
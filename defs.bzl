@@ -11,6 +11,7 @@ def ts_grpc_proto_library(
         deps = [],
         ts_libs = [],
         include = None,
+        policy_options = False,
         protoc = "@com_google_protobuf//:protoc",
         **kargs):
 """
@@ -23,10 +24,17 @@ def ts_grpc_proto_library(
     outs = _GrpcPbTsSrcs(srcs)
     grpc_node_plugin = "@com_github_zaucy_protoc_gen_grpc_node//:protoc-gen-grpc-node"
 
+    # policy_options: srcs import grpc_node/options.proto for its annotations.
+    genproto_deps = [s + "_genproto" for s in deps]
+    if policy_options:
+        genproto_deps.append(
+            "@com_github_zaucy_protoc_gen_grpc_node//:options_genproto",
+        )
+
     proto_gen(
         name = name + "_genproto",
         srcs = srcs,
-        deps = [s + "_genproto" for s in deps],
+        deps = genproto_deps,
         includes = includes,
         protoc = protoc,
         plugin = grpc_node_plugin,
@@ -1,24 +1,168 @@
 #include "grpc-node-generator-options.hh"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <vector>
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/compiler/plugin.h>
 
 using google::protobuf::compiler::ParseGeneratorParameter;
 
+namespace {
+  // A bare flag (`split_services`) counts as enabled.
+  bool parseBoolOption
+    ( const std::string& value
+    )
+  {
+    return value.empty() || value == "true" || value == "1";
+  }
+
+  // Numbers end up in the generated code, so they have to stay exact as
+  // JavaScript numbers.
+  const unsigned long long kMaxNumberOption = (1ULL << 53) - 1;
+
+  // Parses a non-negative decimal. False on anything else, including
+  // numbers too large to parse.
+  bool parseNumberOption
+    ( const std::string&  value
+    , size_t*             number
+    )
+  {
+    if(value.empty() ||
+       value.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+
+    errno = 0;
+    unsigned long long parsed = std::strtoull(value.c_str(), nullptr, 10);
+    if(errno == ERANGE || parsed > kMaxNumberOption ||
+       parsed > std::numeric_limits<size_t>::max()) {
+      return false;
+    }
+
+    *number = static_cast<size_t>(parsed);
+    return true;
+  }
+}
+
 GrpcNodeGeneratorOptions::GrpcNodeGeneratorOptions
   ( const std::string& parameter
   )
+  : splitServices_(false)
+  , cachingClient_(false)
+  , pooledClient_(false)
+  , bench_(false)
+  , inProcess_(false)
+  , passthrough_(false)
+  , offloadThreshold_(1024 * 1024)
+  , asyncStreaming_(false)
+  , streamWindow_(8)
+  , policyReport_(false)
+  , grpcJs_(false)
+  , sizeReport_(false)
+  , sizeReportTop_(5)
+  , messageBackend_(GrpcNodeMessageBackend::Create("google-protobuf"))
+  , deadlinePropagation_(false)
+  , deadlineMarginMs_(0)
+  , admissionControl_(false)
 {
-  // std::vector<std::pair<std::string, std::string>> options;
-  // ParseGeneratorParameter(parameter, &options);
+  std::vector<std::pair<std::string, std::string>> options;
+  ParseGeneratorParameter(parameter, &options);
 
-  // for(const auto& option : options) {
-  //   const std::string& optKey = option.first;
-  //   const std::string& optValue = option.second;
+  for(const auto& option : options) {
+    const std::string& optKey = option.first;
+    const std::string& optValue = option.second;
 
-  //   // @TODO: Add parameter parsing
-  // }
+    if(optKey == "split_services") {
+      splitServices_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "caching_client") {
+      cachingClient_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "pooled_client") {
+      pooledClient_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "bench") {
+      bench_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "in_process") {
+      inProcess_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "passthrough") {
+      passthrough_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "offload_deserialize") {
+      // Parameters are comma separated, so type names are joined with '+'.
+      std::istringstream names(optValue);
+      std::string name;
+      while(std::getline(names, name, '+')) {
+        if(!name.empty()) {
+          offloadDeserialize_.insert(name);
+        }
+      }
+    } else
+    if(optKey == "offload_threshold") {
+      if(!parseNumberOption(optValue, &offloadThreshold_)) {
+        error_ = "offload_threshold must be a number of bytes";
+        return;
+      }
+    } else
+    if(optKey == "async_streaming") {
+      asyncStreaming_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "stream_window") {
+      if(!parseNumberOption(optValue, &streamWindow_) || streamWindow_ == 0) {
+        error_ = "stream_window must be a positive number of messages";
+        return;
+      }
+    } else
+    if(optKey == "policy_report") {
+      policyReport_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "target") {
+      if(optValue != "grpc" && optValue != "grpc-js") {
+        error_ = "Unknown target: " + optValue + " (expected grpc or grpc-js)";
+        return;
+      }
+      grpcJs_ = optValue == "grpc-js";
+    } else
+    if(optKey == "size_report") {
+      sizeReport_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "size_report_top") {
+      if(!parseNumberOption(optValue, &sizeReportTop_)) {
+        error_ = "size_report_top must be a number of protos";
+        return;
+      }
+    } else
+    if(optKey == "serializer") {
+      messageBackend_ = GrpcNodeMessageBackend::Create(optValue);
+      if(!messageBackend_) {
+        error_ = "Unknown serializer: " + optValue +
+          " (expected google-protobuf or protobufjs)";
+        return;
+      }
+    } else
+    if(optKey == "deadline_propagation") {
+      deadlinePropagation_ = parseBoolOption(optValue);
+    } else
+    if(optKey == "deadline_margin_ms") {
+      if(!parseNumberOption(optValue, &deadlineMarginMs_)) {
+        error_ = "deadline_margin_ms must be a number of milliseconds";
+        return;
+      }
+    } else
+    if(optKey == "admission_control") {
+      admissionControl_ = parseBoolOption(optValue);
+    } else {
+      error_ = "Unknown generator option: " + optKey;
+      return;
+    }
+  }
 }
 
 bool GrpcNodeGeneratorOptions::hasError
@@ -39,3 +183,136 @@ const std::map<std::string, std::string> GrpcNodeGeneratorOptions::vars
 {
   return {};
 }
+
+bool GrpcNodeGeneratorOptions::splitServices
+  (
+  ) const
+{
+  return splitServices_;
+}
+
+bool GrpcNodeGeneratorOptions::cachingClient
+  (
+  ) const
+{
+  return cachingClient_;
+}
+
+bool GrpcNodeGeneratorOptions::pooledClient
+  (
+  ) const
+{
+  return pooledClient_;
+}
+
+bool GrpcNodeGeneratorOptions::bench
+  (
+  ) const
+{
+  return bench_;
+}
+
+bool GrpcNodeGeneratorOptions::inProcess
+  (
+  ) const
+{
+  return inProcess_;
+}
+
+bool GrpcNodeGeneratorOptions::passthrough
+  (
+  ) const
+{
+  return passthrough_;
+}
+
+const std::set<std::string>& GrpcNodeGeneratorOptions::offloadDeserialize
+  (
+  ) const
+{
+  return offloadDeserialize_;
+}
+
+bool GrpcNodeGeneratorOptions::isOffloaded
+  ( const std::string& fullName
+  ) const
+{
+  return offloadDeserialize_.count(fullName) > 0;
+}
+
+size_t GrpcNodeGeneratorOptions::offloadThreshold
+  (
+  ) const
+{
+  return offloadThreshold_;
+}
+
+bool GrpcNodeGeneratorOptions::asyncStreaming
+  (
+  ) const
+{
+  return asyncStreaming_;
+}
+
+size_t GrpcNodeGeneratorOptions::streamWindow
+  (
+  ) const
+{
+  return streamWindow_;
+}
+
+bool GrpcNodeGeneratorOptions::policyReport
+  (
+  ) const
+{
+  return policyReport_;
+}
+
+bool GrpcNodeGeneratorOptions::grpcJs
+  (
+  ) const
+{
+  return grpcJs_;
+}
+
+bool GrpcNodeGeneratorOptions::sizeReport
+  (
+  ) const
+{
+  return sizeReport_;
+}
+
+size_t GrpcNodeGeneratorOptions::sizeReportTop
+  (
+  ) const
+{
+  return sizeReportTop_;
+}
+
+const GrpcNodeMessageBackend& GrpcNodeGeneratorOptions::messageBackend
+  (
+  ) const
+{
+  return *messageBackend_;
+}
+
+bool GrpcNodeGeneratorOptions::deadlinePropagation
+  (
+  ) const
+{
+  return deadlinePropagation_;
+}
+
+size_t GrpcNodeGeneratorOptions::deadlineMarginMs
+  (
+  ) const
+{
+  return deadlineMarginMs_;
+}
+
+bool GrpcNodeGeneratorOptions::admissionControl
+  (
+  ) const
+{
+  return admissionControl_;
+}
@@ -2,10 +2,32 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <set>
+
+#include "grpc-node-message-backend.hh"
 
 class GrpcNodeGeneratorOptions {
 private:
   std::string error_;
+  bool splitServices_;
+  bool cachingClient_;
+  bool pooledClient_;
+  bool bench_;
+  bool inProcess_;
+  bool passthrough_;
+  std::set<std::string> offloadDeserialize_;
+  size_t offloadThreshold_;
+  bool asyncStreaming_;
+  size_t streamWindow_;
+  bool policyReport_;
+  bool grpcJs_;
+  bool sizeReport_;
+  size_t sizeReportTop_;
+  std::shared_ptr<const GrpcNodeMessageBackend> messageBackend_;
+  bool deadlinePropagation_;
+  size_t deadlineMarginMs_;
+  bool admissionControl_;
 
 public:
 
@@ -19,4 +41,102 @@ public:
 
   const std::map<std::string, std::string> vars
     () const;
+
+  // `split_services`: emit one module per service plus an index module that
+  // re-exports them, instead of a single _grpc_pb.ts per proto.
+  bool splitServices
+    () const;
+
+  // `caching_client`: emit a <Service>CachingClient that deduplicates
+  // in-flight calls and caches responses of NO_SIDE_EFFECTS unary methods,
+  // per caller key (see the generated `keyFor` option).
+  bool cachingClient
+    () const;
+
+  // `pooled_client`: emit a <Service>PooledClient constructor spreading calls
+  // over several channels.
+  bool pooledClient
+    () const;
+
+  // `bench`: emit a standalone <proto>_<Service>_grpc_bench.ts load-test
+  // harness per service.
+  bool bench
+    () const;
+
+  // `in_process`: emit create<Service>InProcessClient, binding an
+  // implementation directly to the client interface without a channel.
+  bool inProcess
+    () const;
+
+  // `passthrough`: emit a Buffer-in/Buffer-out definition and client per
+  // service for proxies that forward messages without decoding them.
+  bool passthrough
+    () const;
+
+  // `offload_deserialize=pkg.Big+pkg.Huge`: fully qualified message types
+  // whose payloads may be decoded on a worker_threads pool.
+  const std::set<std::string>& offloadDeserialize
+    () const;
+
+  bool isOffloaded
+    ( const std::string& fullName
+    ) const;
+
+  // `offload_threshold=<bytes>`: payloads smaller than this are still
+  // decoded on the calling thread. Defaults to 1 MiB.
+  size_t offloadThreshold
+    () const;
+
+  // `async_streaming`: emit an async-generator handler interface and an
+  // adapter writing its results with backpressure for streaming methods.
+  bool asyncStreaming
+    () const;
+
+  // `stream_window=<messages>`: writes an async_streaming adapter may have
+  // unacknowledged before it stops pulling. Defaults to 8.
+  size_t streamWindow
+    () const;
+
+  // `policy_report`: write <proto>_grpc_policy.json listing the call policy
+  // each method resolves to.
+  bool policyReport
+    () const;
+
+  // `target=grpc|grpc-js`: the runtime package the generated code imports.
+  // The grpc-js target also freezes the definition tables and types the
+  // message transformers.
+  bool grpcJs
+    () const;
+
+  // `size_report`: write grpc_node_size_report.json describing the size and
+  // import fan-out of everything generated for the request.
+  bool sizeReport
+    () const;
+
+  // `size_report_top=<n>`: number of protos listed as worst offenders in the
+  // size report. Defaults to 5.
+  size_t sizeReportTop
+    () const;
+
+  // `serializer=google-protobuf|protobufjs`: the JS protobuf runtime whose
+  // generated message classes the transformers use.
+  const GrpcNodeMessageBackend& messageBackend
+    () const;
+
+  // `deadline_propagation`: emit call contexts carrying an inbound call's
+  // deadline and cancellation, with a server adapter handing them to
+  // handlers and a client deriving downstream CallOptions from them.
+  bool deadlinePropagation
+    () const;
+
+  // `deadline_margin_ms=<ms>`: how much earlier than the inbound deadline
+  // downstream calls expire by default. Defaults to 0.
+  size_t deadlineMarginMs
+    () const;
+
+  // `admission_control`: emit admit<Service>Implementation wrappers that
+  // bound the in-flight calls of each method by the max_concurrent_calls and
+  // max_queued_calls policies, shedding the excess with RESOURCE_EXHAUSTED.
+  bool admissionControl
+    () const;
 };
@@ -1,5 +1,7 @@
 #include "grpc-node-generator-utils.hh"
 
+#include <algorithm>
+
 void GrpcNodeGeneratorUtils::split
   ( const std::string&         str
   , char                       delim
@@ -98,3 +100,93 @@ std::string GrpcNodeGeneratorUtils::getRelativePath
 {
   return GrpcNodeGeneratorUtils::getRootPath(fromFile, toFile) + toFile;
 }
+
+std::string GrpcNodeGeneratorUtils::jsFieldName
+  ( const google::protobuf::FieldDescriptor* field
+  )
+{
+  std::string name;
+  for(const auto& word : tokenize(field->name(), "_")) {
+    std::string lower = word;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    name += capitalizeFirstLetter(lower);
+  }
+
+  // google-protobuf escapes names that clash with its own members.
+  if(name == "Extension" || name == "JsPbMessageId") {
+    name += "$";
+  }
+
+  return name;
+}
+
+// Options are re-parsed so the grpc_node extensions linked into the plugin are
+// recognised regardless of how the descriptor was built.
+grpc_node::MethodPolicy GrpcNodeGeneratorUtils::getOwnMethodPolicy
+  ( const google::protobuf::MethodDescriptor* method
+  )
+{
+  google::protobuf::MethodOptions methodOptions;
+  methodOptions.ParseFromString(method->options().SerializeAsString());
+  return methodOptions.GetExtension(grpc_node::method_policy);
+}
+
+grpc_node::MethodPolicy GrpcNodeGeneratorUtils::getMethodPolicy
+  ( const google::protobuf::MethodDescriptor* method
+  )
+{
+  google::protobuf::ServiceOptions serviceOptions;
+  serviceOptions.ParseFromString(
+    method->service()->options().SerializeAsString());
+
+  grpc_node::MethodPolicy policy =
+    serviceOptions.GetExtension(grpc_node::service_policy);
+  const grpc_node::MethodPolicy methodPolicy = getOwnMethodPolicy(method);
+
+  auto reflection = methodPolicy.GetReflection();
+  std::vector<const google::protobuf::FieldDescriptor*> fields;
+  reflection->ListFields(methodPolicy, &fields);
+  for(auto field : fields) {
+    reflection->ClearField(&policy, field);
+  }
+  policy.MergeFrom(methodPolicy);
+
+  return policy;
+}
+
+bool GrpcNodeGeneratorUtils::getChunkedTransfer
+  ( const google::protobuf::MethodDescriptor*  method
+  , grpc_node::ChunkedTransfer*                transfer
+  )
+{
+  google::protobuf::MethodOptions methodOptions;
+  methodOptions.ParseFromString(method->options().SerializeAsString());
+  if(!methodOptions.HasExtension(grpc_node::chunked_transfer)) {
+    return false;
+  }
+  *transfer = methodOptions.GetExtension(grpc_node::chunked_transfer);
+  return true;
+}
+
+bool GrpcNodeGeneratorUtils::isIdempotent
+  ( const google::protobuf::MethodDescriptor* method
+  )
+{
+  auto level = method->options().idempotency_level();
+  return level == google::protobuf::MethodOptions::IDEMPOTENT ||
+    level == google::protobuf::MethodOptions::NO_SIDE_EFFECTS;
+}
+
+std::string GrpcNodeGeneratorUtils::durationString
+  ( const google::protobuf::Duration& duration
+  )
+{
+  std::string result = std::to_string(duration.seconds());
+  if(duration.nanos() != 0) {
+    std::string nanos = std::to_string(duration.nanos());
+    nanos = std::string(9 - nanos.size(), '0') + nanos;
+    nanos.erase(nanos.find_last_not_of('0') + 1);
+    result += "." + nanos;
+  }
+  return result + "s";
+}
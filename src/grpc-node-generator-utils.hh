@@ -7,6 +7,8 @@
 #include <google/protobuf/descriptor.pb.h>
 #include <google/protobuf/compiler/code_generator.h>
 
+#include "grpc_node/options.pb.h"
+
 namespace GrpcNodeGeneratorUtils {
 
   inline bool stripSuffix(std::string* filename, const std::string& suffix) {
@@ -284,4 +286,41 @@ namespace GrpcNodeGeneratorUtils {
     ( const std::string& name
     );
 
+  // Name google-protobuf's JS generator uses in the accessors of `field`,
+  // e.g. foo_bar -> FooBar for getFooBar/setFooBar. Repeated and map fields
+  // get their List/Map suffix appended by the caller.
+  std::string jsFieldName
+    ( const google::protobuf::FieldDescriptor* field
+    );
+
+  // Returns the (grpc_node.method_policy) set directly on `method`
+  grpc_node::MethodPolicy getOwnMethodPolicy
+    ( const google::protobuf::MethodDescriptor* method
+    );
+
+  // Returns the (grpc_node.method_policy) of `method` layered over the
+  // (grpc_node.service_policy) of its service. A field set on the method
+  // replaces the service default entirely.
+  grpc_node::MethodPolicy getMethodPolicy
+    ( const google::protobuf::MethodDescriptor* method
+    );
+
+  // Returns whether (grpc_node.chunked_transfer) is set on `method`, storing
+  // it in `transfer`
+  bool getChunkedTransfer
+    ( const google::protobuf::MethodDescriptor*  method
+    , grpc_node::ChunkedTransfer*                transfer
+    );
+
+  // Whether the method is declared free of side effects or idempotent, i.e.
+  // safe to send more than once.
+  bool isIdempotent
+    ( const google::protobuf::MethodDescriptor* method
+    );
+
+  // Formats a duration the way a gRPC service config expects it, e.g. "1.5s"
+  std::string durationString
+    ( const google::protobuf::Duration& duration
+    );
+
 } // namespace GrpcNodeGeneratorUtils
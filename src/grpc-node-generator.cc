@@ -2,7 +2,9 @@
 
 #include "grpc-node-generator-utils.hh"
 
+#include <algorithm>
 #include <cctype>
+#include <deque>
 #include <set>
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/compiler/plugin.h>
@@ -25,6 +27,22 @@ using google::protobuf::io::ZeroCopyOutputStream;
 namespace utils = GrpcNodeGeneratorUtils;
 
 namespace {
+  /* Finds all message types used in the service's methods, and returns them
+  * as a map of fully qualified message type name to message descriptor */
+  std::map<std::string, const Descriptor*> GetServiceMessages(
+      const ServiceDescriptor* service) {
+    std::map<std::string, const Descriptor*> message_types;
+    for (int method_num = 0; method_num < service->method_count();
+        method_num++) {
+      const MethodDescriptor* method = service->method(method_num);
+      const Descriptor* input_type = method->input_type();
+      const Descriptor* output_type = method->output_type();
+      message_types[input_type->full_name()] = input_type;
+      message_types[output_type->full_name()] = output_type;
+    }
+    return message_types;
+  }
+
   /* Finds all message types used in all services in the file, and returns them
   * as a map of fully qualified message type name to message descriptor */
   std::map<std::string, const Descriptor*> GetAllMessages(
@@ -32,24 +50,12 @@ namespace {
     std::map<std::string, const Descriptor*> message_types;
     for (int service_num = 0; service_num < file->service_count();
         service_num++) {
-      const ServiceDescriptor* service = file->service(service_num);
-      for (int method_num = 0; method_num < service->method_count();
-          method_num++) {
-        const MethodDescriptor* method = service->method(method_num);
-        const Descriptor* input_type = method->input_type();
-        const Descriptor* output_type = method->output_type();
-        message_types[input_type->full_name()] = input_type;
-        message_types[output_type->full_name()] = output_type;
-      }
+      auto service_types = GetServiceMessages(file->service(service_num));
+      message_types.insert(service_types.begin(), service_types.end());
     }
     return message_types;
   }
 
-  std::string GetTsMessageFilename(const std::string& filename) {
-    std::string name = filename;
-    return utils::stripProto(name) + "_pb";
-  }
-
   std::string GetMethodInterfaceName(const MethodDescriptor* method) {
     std::string methodInterfaceName =
       utils::lowercaseFirstLetter(method->name());
@@ -60,435 +66,5007 @@ namespace {
 
     return methodInterfaceName;
   }
-}
 
-bool GrpcNodeGenerator::PrintServiceImplementationInterface
-  ( google::protobuf::io::Printer&              printer
-  , const GrpcNodeGeneratorOptions&          options
-  , const google::protobuf::ServiceDescriptor*  service
-  , std::string*                                error
-  ) const
-{
+  // Property access for the method on a client or implementation object:
+  // `.name`, or `['new']` where the interface name has to be quoted.
+  std::string GetMethodAccessor(const MethodDescriptor* method) {
+    std::string methodKey = utils::lowercaseFirstLetter(method->name());
 
-  std::map<std::string, std::string> vars = {
-    {"ServiceName", service->name()}
+    if(methodKey == "new") {
+      return "['new']";
+    }
+
+    return "." + methodKey;
+  }
+
+  // Filename (without extension) of the module generated for `service` when
+  // the split_services option is set.
+  std::string GetServiceModuleFilename(const ServiceDescriptor* service) {
+    return utils::removePathExtname(service->file()->name()) + "_" +
+      service->name() + "_grpc_pb";
+  }
+
+  std::string GetBasename(const std::string& path) {
+    auto lastSlashIndex = path.find_last_of('/');
+    if(lastSlashIndex != std::string::npos) {
+      return path.substr(lastSlashIndex + 1);
+    }
+    return path;
+  }
+
+  bool IsPositive(const google::protobuf::Duration& duration) {
+    return duration.seconds() > 0 ||
+      (duration.seconds() == 0 && duration.nanos() > 0);
+  }
+
+  /* Resolves the policy that goes into the service config for `method`,
+  * rejecting combinations gRPC would refuse at runtime */
+  bool GetServiceConfigPolicy
+    ( const MethodDescriptor*   method
+    , grpc_node::MethodPolicy*  policy
+    , std::string*              error
+    )
+  {
+    *policy = utils::getMethodPolicy(method);
+    grpc_node::MethodPolicy own = utils::getOwnMethodPolicy(method);
+    const std::string& name = method->full_name();
+
+    if(own.has_retry_policy() && own.has_hedging_policy()) {
+      *error = name + ": retry_policy and hedging_policy are mutually "
+        "exclusive";
+      return false;
+    }
+
+    // A policy on the method wins over the other kind set on the service.
+    if(own.has_retry_policy()) {
+      policy->clear_hedging_policy();
+    }
+    if(own.has_hedging_policy()) {
+      policy->clear_retry_policy();
+    }
+
+    if(policy->has_hedging_policy() && !utils::isIdempotent(method)) {
+      if(own.has_hedging_policy()) {
+        *error = name + ": hedging_policy requires idempotency_level "
+          "IDEMPOTENT or NO_SIDE_EFFECTS";
+        return false;
+      }
+      policy->clear_hedging_policy();
+    }
+
+    if(policy->has_retry_policy() && policy->has_hedging_policy()) {
+      *error = method->service()->full_name() + ": retry_policy and "
+        "hedging_policy are mutually exclusive";
+      return false;
+    }
+
+    if(policy->has_retry_policy()) {
+      const auto& retry = policy->retry_policy();
+      if(retry.max_attempts() < 2) {
+        *error = name + ": retry_policy.max_attempts must be at least 2";
+        return false;
+      }
+      if(!IsPositive(retry.initial_backoff()) ||
+         !IsPositive(retry.max_backoff())) {
+        *error = name + ": retry_policy.initial_backoff and max_backoff "
+          "must be positive";
+        return false;
+      }
+      if(!(retry.backoff_multiplier() > 0)) {
+        *error = name + ": retry_policy.backoff_multiplier must be positive";
+        return false;
+      }
+      if(retry.retryable_status_codes_size() == 0) {
+        *error = name + ": retry_policy.retryable_status_codes must not be "
+          "empty";
+        return false;
+      }
+    }
+
+    if(policy->has_hedging_policy()) {
+      if(policy->hedging_policy().max_attempts() < 2) {
+        *error = name + ": hedging_policy.max_attempts must be at least 2";
+        return false;
+      }
+    }
+
+    if(policy->has_timeout() && !IsPositive(policy->timeout())) {
+      *error = name + ": timeout must be positive";
+      return false;
+    }
+
+    if(policy->has_compression_threshold_bytes() &&
+       policy->compression() == grpc_node::IDENTITY) {
+      *error = name + ": compression_threshold_bytes requires a compression "
+        "other than IDENTITY";
+      return false;
+    }
+
+    if((policy->has_max_request_message_bytes() &&
+        policy->max_request_message_bytes() == 0) ||
+       (policy->has_max_response_message_bytes() &&
+        policy->max_response_message_bytes() == 0)) {
+      *error = name + ": message size limits must be positive";
+      return false;
+    }
+
+    if(policy->has_max_concurrent_calls() &&
+       policy->max_concurrent_calls() == 0) {
+      *error = name + ": max_concurrent_calls must be positive";
+      return false;
+    }
+
+    if(policy->has_max_queued_calls() && !policy->has_max_concurrent_calls()) {
+      *error = name + ": max_queued_calls requires max_concurrent_calls";
+      return false;
+    }
+
+    return true;
+  }
+
+  bool HasServiceConfigEntry(const grpc_node::MethodPolicy& policy) {
+    return policy.has_retry_policy() || policy.has_hedging_policy() ||
+      policy.has_timeout() || policy.has_wait_for_ready() ||
+      policy.has_max_request_message_bytes() ||
+      policy.has_max_response_message_bytes();
+  }
+
+  bool HasCallPolicyEntry(const grpc_node::MethodPolicy& policy) {
+    return policy.has_compression() ||
+      policy.has_max_request_message_bytes() ||
+      policy.has_max_response_message_bytes();
+  }
+
+  // Methods whose client calls go through grpcNodeCompressedCall.
+  bool HasCompressionPolicy(const ServiceDescriptor* service) {
+    for(auto i=0; service->method_count() > i; ++i) {
+      if(utils::getMethodPolicy(service->method(i)).has_compression()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Limit gRPC puts on the messages a server receives; sends are unlimited.
+  const int64_t kDefaultMaxReceiveMessageBytes = 4 * 1024 * 1024;
+
+  // Channel-wide message size limits of a server, -1 meaning unlimited.
+  struct MessageSizeLimits {
+    int64_t receive;
+    int64_t send;
   };
 
-  printer.Print(vars, "export interface I$ServiceName$Implementation {\n");
-  printer.Indent();
+  /* Server limits for `service`: the largest method limit when every method
+  * sets one, and otherwise gRPC's default raised to the largest method limit,
+  * so that methods without a limit keep the default */
+  MessageSizeLimits GetServerMessageSizeLimits(const ServiceDescriptor* service) {
+    bool allRequests = true;
+    bool allResponses = true;
+    int64_t maxRequestBytes = 0;
+    int64_t maxResponseBytes = 0;
+
+    for(auto i=0; service->method_count() > i; ++i) {
+      auto policy = utils::getMethodPolicy(service->method(i));
+      if(policy.has_max_request_message_bytes()) {
+        maxRequestBytes = std::max<int64_t>(
+          maxRequestBytes, policy.max_request_message_bytes());
+      } else {
+        allRequests = false;
+      }
+      if(policy.has_max_response_message_bytes()) {
+        maxResponseBytes = std::max<int64_t>(
+          maxResponseBytes, policy.max_response_message_bytes());
+      } else {
+        allResponses = false;
+      }
+    }
+
+    MessageSizeLimits limits;
+    limits.receive = allRequests ? maxRequestBytes :
+      std::max(kDefaultMaxReceiveMessageBytes, maxRequestBytes);
+    limits.send = allResponses ? maxResponseBytes : -1;
+    return limits;
+  }
+
+  bool IsBelowLimit(int64_t bytes, int64_t limit) {
+    return limit < 0 || bytes < limit;
+  }
+
+  // Whether `method` sets a request size limit below the server's, which
+  // then has to be checked by the handler.
+  bool HasHandlerRequestLimit
+    ( const MethodDescriptor*   method
+    , const MessageSizeLimits&  limits
+    )
+  {
+    auto policy = utils::getMethodPolicy(method);
+    return policy.has_max_request_message_bytes() &&
+      IsBelowLimit(policy.max_request_message_bytes(), limits.receive);
+  }
+
+  bool HasHandlerResponseLimit
+    ( const MethodDescriptor*   method
+    , const MessageSizeLimits&  limits
+    )
+  {
+    auto policy = utils::getMethodPolicy(method);
+    return policy.has_max_response_message_bytes() &&
+      IsBelowLimit(policy.max_response_message_bytes(), limits.send);
+  }
+
+  bool HasHandlerSizeLimit
+    ( const MethodDescriptor*   method
+    , const MessageSizeLimits&  limits
+    )
+  {
+    return HasHandlerRequestLimit(method, limits) ||
+      HasHandlerResponseLimit(method, limits);
+  }
+
+  bool HasHandlerSizeLimit(const ServiceDescriptor* service) {
+    auto limits = GetServerMessageSizeLimits(service);
+    for(auto i=0; service->method_count() > i; ++i) {
+      if(HasHandlerSizeLimit(service->method(i), limits)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* Fields of `descriptor` that chunked transfer splits: bytes fields
+  * outside oneofs and repeated fields other than maps */
+  std::vector<const FieldDescriptor*> GetChunkedFields
+    ( const Descriptor* descriptor
+    )
+  {
+    std::vector<const FieldDescriptor*> fields;
+    for(auto i=0; descriptor->field_count() > i; ++i) {
+      auto field = descriptor->field(i);
+      if(field->is_repeated() ? !field->is_map() :
+         field->type() == FieldDescriptor::TYPE_BYTES &&
+           field->containing_oneof() == nullptr) {
+        fields.push_back(field);
+      }
+    }
+    return fields;
+  }
+
+  bool IsChunked(const MethodDescriptor* method) {
+    grpc_node::ChunkedTransfer transfer;
+    return utils::getChunkedTransfer(method, &transfer);
+  }
+
+  // Encoded size of an element of the repeated `field`, or an upper bound
+  // of it for varints.
+  std::string ElementSizeExpression
+    ( const GrpcNodeGeneratorOptions&  options
+    , const FieldDescriptor*           field
+    , const std::string&               value
+    )
+  {
+    switch(field->type()) {
+      case FieldDescriptor::TYPE_DOUBLE:
+      case FieldDescriptor::TYPE_FIXED64:
+      case FieldDescriptor::TYPE_SFIXED64:
+        return "8";
+      case FieldDescriptor::TYPE_FLOAT:
+      case FieldDescriptor::TYPE_FIXED32:
+      case FieldDescriptor::TYPE_SFIXED32:
+        return "4";
+      case FieldDescriptor::TYPE_BOOL:
+        return "1";
+      case FieldDescriptor::TYPE_STRING:
+        return "Buffer.byteLength(" + value + ") + 5";
+      case FieldDescriptor::TYPE_BYTES:
+        return value + ".length + 5";
+      case FieldDescriptor::TYPE_MESSAGE:
+      case FieldDescriptor::TYPE_GROUP:
+        return options.messageBackend().EncodedSizeExpression(value) + " + 5";
+      default:
+        return "10";
+    }
+  }
+
+  /* Prints grpcNodeChunk_<id>, splitting a message into chunks, and
+  * GrpcNodeAssembler_<id>, joining them again */
+  void PrintMessageChunker
+    ( Printer&                         printer
+    , const GrpcNodeGeneratorOptions&  options
+    , const Descriptor*                descriptor
+    )
+  {
+    const auto& backend = options.messageBackend();
+    std::map<std::string, std::string> vars;
+    vars["name"] = descriptor->full_name();
+    vars["identifierName"] =
+      utils::messageIdentifierName(descriptor->full_name());
+    vars["TypePath"] = backend.TypePath(descriptor);
+    auto fields = GetChunkedFields(descriptor);
+
+    if(fields.empty()) {
+      printer.Print(vars,
+        "// $name$ has nothing to split and travels as one chunk.\n"
+        "function* grpcNodeChunk_$identifierName$\n"
+        "  ( message: $TypePath$\n"
+        "  , chunkBytes: number\n"
+        "  ): IterableIterator<$TypePath$> {\n"
+        "  yield message;\n"
+        "}\n\n"
+        "class GrpcNodeAssembler_$identifierName$ {\n"
+        "  private message: $TypePath$ | undefined;\n"
+        "\n"
+        "  push(chunk: $TypePath$): void {\n"
+        "    if (this.message === undefined) {\n"
+        "      this.message = chunk;\n"
+        "    }\n"
+        "  }\n"
+        "\n"
+        "  finish(): $TypePath$ {\n"
+        "    return this.message || new $TypePath$();\n"
+        "  }\n"
+        "}\n\n");
+      return;
+    }
+
+    std::string fieldList;
+    for(auto field : fields) {
+      fieldList += (fieldList.empty() ? "" : ", ") + field->name();
+    }
+    vars["fieldList"] = fieldList;
+
+    printer.Print(vars,
+      "// Splits a $name$ into messages holding about `chunkBytes` encoded\n"
+      "// bytes of $fieldList$. The first one also\n"
+      "// carries every other field.\n"
+      "function* grpcNodeChunk_$identifierName$\n"
+      "  ( message: $TypePath$\n"
+      "  , chunkBytes: number\n"
+      "  ): IterableIterator<$TypePath$> {\n");
+    printer.Indent();
+    for(auto field : fields) {
+      vars["field"] = field->camelcase_name();
+      vars["get"] = backend.GetFieldExpression(field, "message");
+      printer.Print(vars,
+        "const $field$Field = $get$;\n"
+        "let $field$Offset = 0;\n");
+    }
+    vars["copy"] = backend.ShallowCopyExpression(vars["TypePath"], "message");
+    printer.Print(vars,
+      "let chunk = $copy$;\n"
+      "for (;;) {\n");
+    printer.Indent();
+    printer.Print("let budget = chunkBytes;\n");
+    for(auto field : fields) {
+      vars["field"] = field->camelcase_name();
+      if(field->is_repeated()) {
+        vars["size"] = ElementSizeExpression(options, field,
+          field->camelcase_name() + "Field[" + field->camelcase_name() +
+          "Offset]");
+        vars["set"] = backend.SetRepeatedFieldStatement(field, "chunk",
+          field->camelcase_name() + "Field.slice(" + field->camelcase_name() +
+          "Start, " + field->camelcase_name() + "Offset)");
+        printer.Print(vars,
+          "const $field$Start = $field$Offset;\n"
+          "while ($field$Offset < $field$Field.length && budget > 0) {\n"
+          "  budget -= $size$;\n"
+          "  $field$Offset++;\n"
+          "}\n"
+          "$set$\n");
+      } else {
+        vars["set"] = backend.SetFieldStatement(field, "chunk",
+          field->camelcase_name() + "Field.subarray(" +
+          field->camelcase_name() + "Offset, " + field->camelcase_name() +
+          "End)");
+        printer.Print(vars,
+          "const $field$End = Math.min($field$Field.length,\n"
+          "  $field$Offset + Math.max(budget, 0));\n"
+          "$set$\n"
+          "budget -= $field$End - $field$Offset;\n"
+          "$field$Offset = $field$End;\n");
+      }
+    }
+    printer.Print("yield chunk;\n");
+    for(size_t i = 0; fields.size() > i; ++i) {
+      printer.Print(
+        i == 0 ? "if ($field$Offset >= $field$Field.length" :
+          "    $field$Offset >= $field$Field.length",
+        "field", fields[i]->camelcase_name());
+      printer.Print(i + 1 == fields.size() ? ") {\n" : " &&\n");
+    }
+    printer.Print(vars,
+      "  return;\n"
+      "}\n"
+      "chunk = new $TypePath$();\n");
+    printer.Outdent();
+    printer.Print("}\n");
+    printer.Outdent();
+    printer.Print("}\n\n");
+
+    printer.Print(vars,
+      "// Rebuilds a $name$ from its chunks. List elements are appended as\n"
+      "// chunks arrive; bytes slices are joined once by finish().\n"
+      "class GrpcNodeAssembler_$identifierName$ {\n");
+    printer.Indent();
+    printer.Print(vars, "private message: $TypePath$ | undefined;\n");
+    for(auto field : fields) {
+      vars["field"] = field->camelcase_name();
+      printer.Print(vars, field->is_repeated() ?
+        "private $field$: any[] = [];\n" :
+        "private $field$Parts: Uint8Array[] = [];\n");
+    }
+    printer.Print(vars,
+      "\n"
+      "push(chunk: $TypePath$): void {\n"
+      "  if (this.message === undefined) {\n"
+      "    this.message = chunk;\n"
+      "  }\n");
+    printer.Indent();
+    for(auto field : fields) {
+      vars["field"] = field->camelcase_name();
+      vars["get"] = backend.GetFieldExpression(field, "chunk");
+      if(field->is_repeated()) {
+        printer.Print(vars,
+          "const $field$ = $get$;\n"
+          "for (let i = 0; i < $field$.length; i++) {\n"
+          "  this.$field$.push($field$[i]);\n"
+          "}\n");
+      } else {
+        printer.Print(vars, "this.$field$Parts.push($get$);\n");
+      }
+    }
+    printer.Outdent();
+    printer.Print(vars,
+      "}\n"
+      "\n"
+      "finish(): $TypePath$ {\n"
+      "  const message = this.message || new $TypePath$();\n");
+    printer.Indent();
+    for(auto field : fields) {
+      if(field->is_repeated()) {
+        printer.Print("$set$\n", "set", backend.SetRepeatedFieldStatement(
+          field, "message", "this." + field->camelcase_name()));
+      } else {
+        printer.Print("$set$\n", "set", backend.SetFieldStatement(
+          field, "message",
+          "Buffer.concat(this." + field->camelcase_name() + "Parts)"));
+      }
+    }
+    printer.Print("return message;\n");
+    printer.Outdent();
+    printer.Print("}\n");
+    printer.Outdent();
+    printer.Print("}\n\n");
+  }
+
+  /* Admission priority of `method`: calls of a lower priority are shed
+  * first. Calls without side effects are the safest for a client to retry,
+  * calls of unknown idempotency the least safe */
+  int AdmissionPriority(const MethodDescriptor* method) {
+    switch(method->options().idempotency_level()) {
+      case google::protobuf::MethodOptions::NO_SIDE_EFFECTS:
+        return 0;
+      case google::protobuf::MethodOptions::IDEMPOTENT:
+        return 1;
+      default:
+        return 2;
+    }
+  }
+
+  // Name of the algorithm as grpc-internal-encoding-request expects it.
+  std::string CompressionName(grpc_node::Compression compression) {
+    std::string name = grpc_node::Compression_Name(compression);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+  }
+
+  bool HasServiceConfig(const ServiceDescriptor* service) {
+    for(auto i=0; service->method_count() > i; ++i) {
+      grpc_node::MethodPolicy policy;
+      std::string error;
+      if(GetServiceConfigPolicy(service->method(i), &policy, &error) &&
+         HasServiceConfigEntry(policy)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::string StatusCodeList
+    ( const google::protobuf::RepeatedField<int>& codes
+    )
+  {
+    std::string result = "[";
+    for(auto i=0; codes.size() > i; ++i) {
+      if(i > 0) {
+        result += ", ";
+      }
+      result += "'" + grpc_node::StatusCode_Name(
+        static_cast<grpc_node::StatusCode>(codes.Get(i))) + "'";
+    }
+    return result + "]";
+  }
+
+  // Unary methods declared NO_SIDE_EFFECTS, whose responses may be shared
+  // between identical requests.
+  bool IsCacheable(const MethodDescriptor* method) {
+    return utils::getMethodType(method) == utils::METHODTYPE_NO_STREAMING &&
+      method->options().idempotency_level() ==
+        google::protobuf::MethodOptions::NO_SIDE_EFFECTS;
+  }
+
+  bool HasCacheableMethod(const ServiceDescriptor* service) {
+    for(auto i=0; service->method_count() > i; ++i) {
+      if(IsCacheable(service->method(i))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* Finds every message type reachable through the fields of `descriptor`,
+  * including itself, keyed by fully qualified name */
+  void GetReachableMessages
+    ( const Descriptor*                           descriptor
+    , std::map<std::string, const Descriptor*>*  out
+    )
+  {
+    if(descriptor->options().map_entry()) {
+      auto value = descriptor->FindFieldByName("value");
+      if(value->message_type() != nullptr) {
+        GetReachableMessages(value->message_type(), out);
+      }
+      return;
+    }
+
+    if(!out->insert({descriptor->full_name(), descriptor}).second) {
+      return;
+    }
+
+    for(auto i=0; descriptor->field_count() > i; ++i) {
+      auto field = descriptor->field(i);
+      if(field->message_type() != nullptr) {
+        GetReachableMessages(field->message_type(), out);
+      }
+    }
+  }
+
+  // TypeScript expression of a synthetic value for a singular `field`
+  std::string SyntheticValue(const FieldDescriptor* field) {
+    switch(field->type()) {
+      case FieldDescriptor::TYPE_DOUBLE:
+      case FieldDescriptor::TYPE_FLOAT:
+        return "1.5";
+      case FieldDescriptor::TYPE_INT64:
+      case FieldDescriptor::TYPE_UINT64:
+      case FieldDescriptor::TYPE_SINT64:
+      case FieldDescriptor::TYPE_FIXED64:
+      case FieldDescriptor::TYPE_SFIXED64:
+        if(field->options().jstype() ==
+           google::protobuf::FieldOptions::JS_STRING) {
+          return "'42'";
+        }
+        return "42";
+      case FieldDescriptor::TYPE_INT32:
+      case FieldDescriptor::TYPE_UINT32:
+      case FieldDescriptor::TYPE_SINT32:
+      case FieldDescriptor::TYPE_FIXED32:
+      case FieldDescriptor::TYPE_SFIXED32:
+        return "42";
+      case FieldDescriptor::TYPE_BOOL:
+        return "true";
+      case FieldDescriptor::TYPE_STRING:
+        return "'x'.repeat(options.payloadBytes)";
+      case FieldDescriptor::TYPE_BYTES:
+        return "new Uint8Array(options.payloadBytes)";
+      case FieldDescriptor::TYPE_ENUM: {
+        // Prefer a non-default value so the field is actually encoded.
+        auto enumType = field->enum_type();
+        auto value = enumType->value(enumType->value_count() > 1 ? 1 : 0);
+        return std::to_string(value->number());
+      }
+      case FieldDescriptor::TYPE_MESSAGE:
+      case FieldDescriptor::TYPE_GROUP:
+        return "synthesize_" +
+          utils::messageIdentifierName(field->message_type()->full_name()) +
+          "(options, depth + 1)";
+    }
+    return "undefined";
+  }
+
+  // TypeScript expression of the i-th synthetic key of a map `field`
+  std::string SyntheticMapKey(const FieldDescriptor* keyField) {
+    switch(keyField->type()) {
+      case FieldDescriptor::TYPE_STRING:
+        return "'k' + i";
+      case FieldDescriptor::TYPE_BOOL:
+        return "i % 2 === 0";
+      default:
+        return "i";
+    }
+  }
+
+  // Prints the implementation member for `method` using the RequestType and
+  // ResponseType in `vars`
+  void PrintHandlerMember
+    ( Printer&                                   printer
+    , const std::map<std::string, std::string>&  vars
+    , const MethodDescriptor*                    method
+    )
+  {
+    if(method->client_streaming() && method->server_streaming()) {
+      printer.Print(vars, "$methodName$: "
+        "grpc.handleBidiStreamingCall<$RequestType$, $ResponseType$>;\n");
+    } else
+    if(method->client_streaming()) {
+      printer.Print(vars, "$methodName$: "
+        "grpc.handleClientStreamingCall<$RequestType$, $ResponseType$>;\n");
+    } else
+    if(method->server_streaming()) {
+      printer.Print(vars, "$methodName$: "
+        "grpc.handleServerStreamingCall<$RequestType$, $ResponseType$>;\n");
+    } else {
+      printer.Print(vars, "$methodName$: "
+        "grpc.handleUnaryCall<$RequestType$, $ResponseType$>;\n");
+    }
+  }
+
+  // Prints the client interface overloads for `method` using the
+  // RequestType and ResponseType in `vars`
+  void PrintClientMethodOverloads
+    ( Printer&                                   printer
+    , const std::map<std::string, std::string>&  vars
+    , const MethodDescriptor*                    method
+    )
+  {
+    if(method->client_streaming() && method->server_streaming()) {
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars,
+        "(): grpc.ClientDuplexStream<$RequestType$, $ResponseType$>;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars,
+        "(metadata: grpc.Metadata | null): "
+        "grpc.ClientDuplexStream<$RequestType$, $ResponseType$>;\n");
+      printer.Outdent();
+    } else
+    if(method->client_streaming()) {
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "(): grpc.ClientWritableStream<$RequestType$>;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "(metadata: grpc.Metadata | null): grpc.ClientWritableStream<$RequestType$>;\n");
+      printer.Outdent();
+    } else
+    if(method->server_streaming()) {
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, "): grpc.ClientReadableStream<$ResponseType$>;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
+      printer.Print(vars, "): grpc.ClientReadableStream<$ResponseType$>;\n");
+      printer.Outdent();
+    } else {
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
+      printer.Print(vars, "): void;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
+      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
+      printer.Print(vars, "): void;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
+      printer.Print(vars, ", options: grpc.CallOptions | null\n");
+      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
+      printer.Print(vars, "): void;\n\n");
+      printer.Outdent();
+    }
+  }
+
+  bool HasServerStreamingMethod
+    ( const ServiceDescriptor*  service
+    , bool                      bidiOnly
+    )
+  {
+    for(auto i=0; service->method_count() > i; ++i) {
+      auto method = service->method(i);
+      if(method->server_streaming() &&
+         (!bidiOnly || method->client_streaming())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Requests are decoded off the event loop for methods receiving a single
+  // message of an offloaded type.
+  bool IsOffloadedRequest
+    ( const GrpcNodeGeneratorOptions&  options
+    , const MethodDescriptor*          method
+    )
+  {
+    return !method->client_streaming() &&
+      options.isOffloaded(method->input_type()->full_name());
+  }
+
+  // Responses are decoded off the event loop for unary methods returning an
+  // offloaded type, through the offload promise client.
+  bool IsOffloadedResponse
+    ( const GrpcNodeGeneratorOptions&  options
+    , const MethodDescriptor*          method
+    )
+  {
+    return utils::getMethodType(method) == utils::METHODTYPE_NO_STREAMING &&
+      options.isOffloaded(method->output_type()->full_name());
+  }
+
+  // Offloaded message types sent or received by `services`, in order of use.
+  std::vector<const Descriptor*> GetOffloadedMessages
+    ( const GrpcNodeGeneratorOptions&              options
+    , const std::vector<const ServiceDescriptor*>&  services
+    )
+  {
+    std::vector<const Descriptor*> offloaded;
+    for(auto service : services) {
+      for(const auto& it : GetServiceMessages(service)) {
+        if(options.isOffloaded(it.first) &&
+           std::find(offloaded.begin(), offloaded.end(), it.second) ==
+             offloaded.end()) {
+          offloaded.push_back(it.second);
+        }
+      }
+    }
+    return offloaded;
+  }
+
+  // Filename (without extension) of the module the offload pool workers of
+  // `file` run.
+  std::string GetOffloadWorkerFilename(const FileDescriptor* file) {
+    return utils::removePathExtname(file->name()) + "_grpc_worker";
+  }
+
+  // Every offload_deserialize name has to be a message some service of
+  // `files` sends or receives, so a typo does not silently disable it.
+  bool CheckOffloadedTypes
+    ( const std::vector<const FileDescriptor*>&  files
+    , const GrpcNodeGeneratorOptions&            options
+    , std::string*                               error
+    )
+  {
+    std::set<std::string> used;
+    for(auto file : files) {
+      for(const auto& it : GetAllMessages(file)) {
+        used.insert(it.first);
+      }
+    }
+
+    for(const auto& name : options.offloadDeserialize()) {
+      if(used.count(name) == 0) {
+        *error = "offload_deserialize: " + name + " is not a request or "
+          "response type of any service";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void PrintGrpcImport
+    ( Printer&                         printer
+    , const GrpcNodeGeneratorOptions&  options
+    , GrpcNodeModuleStats*             stats = nullptr
+    )
+  {
+    if(stats != nullptr) {
+      ++stats->imports;
+    }
+    if(options.grpcJs()) {
+      printer.Print("import * as grpc from '@grpc/grpc-js';\n");
+    } else {
+      printer.Print("import * as grpc from 'grpc';\n");
+    }
+  }
+
+  // grpc-js only accepts implementations with an index signature, and its
+  // server calls are typed by response as well.
+  std::string ImplementationBase(const GrpcNodeGeneratorOptions& options) {
+    return options.grpcJs() ? " extends grpc.UntypedServiceImplementation" : "";
+  }
+
+  // Type of the call object a server handler of `method` receives
+  std::string ServerCallType
+    ( const GrpcNodeGeneratorOptions&  options
+    , const MethodDescriptor*          method
+    )
+  {
+    std::string requestType =
+      options.messageBackend().TypePath(method->input_type());
+    std::string responseType =
+      options.messageBackend().TypePath(method->output_type());
+
+    if(method->client_streaming() && method->server_streaming()) {
+      return "grpc.ServerDuplexStream<" + requestType + ", " +
+        responseType + ">";
+    }
+
+    std::string type = method->client_streaming() ? "ServerReadableStream" :
+      method->server_streaming() ? "ServerWritableStream" : "ServerUnaryCall";
+    type = "grpc." + type + "<" + requestType;
+    if(options.grpcJs()) {
+      type += ", " + responseType;
+    }
+    return type + ">";
+  }
+
+  // Node.js core modules the runtime helpers depend on.
+  std::vector<std::string> GetNodeModules
+    ( const GrpcNodeGeneratorOptions& options
+    )
+  {
+    std::vector<std::string> modules;
+    if(options.inProcess()) {
+      modules.push_back("stream");
+    }
+    if(!options.offloadDeserialize().empty()) {
+      modules.push_back("os");
+      modules.push_back("worker_threads");
+    }
+    return modules;
+  }
+
+  void PrintNodeImports
+    ( Printer&                         printer
+    , const GrpcNodeGeneratorOptions&  options
+    , GrpcNodeModuleStats*             stats = nullptr
+    )
+  {
+    for(const auto& module : GetNodeModules(options)) {
+      printer.Print("import * as $module$ from '$module$';\n",
+        "module", module);
+      if(stats != nullptr) {
+        ++stats->imports;
+      }
+    }
+  }
+
+  // Proto files whose _pb modules the single module generated for `file`
+  // imports. grpc_node/options.proto only carries annotations read by the
+  // generator, so it is never needed at runtime.
+  std::vector<const FileDescriptor*> GetImportedProtoFiles
+    ( const FileDescriptor* file
+    )
+  {
+    std::vector<const FileDescriptor*> files;
+    if(file->message_type_count() > 0) {
+      files.push_back(file);
+    }
+    for(auto i=0; file->dependency_count() > i; ++i) {
+      if(file->dependency(i)->name() != "grpc_node/options.proto") {
+        files.push_back(file->dependency(i));
+      }
+    }
+    return files;
+  }
+
+  // Proto files whose _pb modules the split module of `service` imports,
+  // ordered by name.
+  std::vector<const FileDescriptor*> GetServiceImportedProtoFiles
+    ( const ServiceDescriptor* service
+    )
+  {
+    std::map<std::string, const FileDescriptor*> byName;
+    for(const auto& it : GetServiceMessages(service)) {
+      byName[it.second->file()->name()] = it.second->file();
+    }
+
+    std::vector<const FileDescriptor*> files;
+    for(const auto& it : byName) {
+      files.push_back(it.second);
+    }
+    return files;
+  }
+
+  // Imports the _pb module of `protoFilename` into the generated file of
+  // `fromFilename`.
+  void PrintMessageModuleImport
+    ( Printer&                         printer
+    , const GrpcNodeGeneratorOptions&  options
+    , const std::string&               fromFilename
+    , const std::string&               protoFilename
+    )
+  {
+    const auto& backend = options.messageBackend();
+    std::string filePath = utils::getRelativePath(
+      fromFilename, backend.ModuleFilename(protoFilename));
+
+    printer.Print("import * as $ModuleAlias$ from '$filePath$';\n",
+      "ModuleAlias", backend.ModuleAlias(protoFilename),
+      "filePath", filePath);
+  }
+
+  // Adds `file` and every file it depends on: loading a _pb module loads the
+  // _pb modules of all its dependencies.
+  void CollectPbModules
+    ( const FileDescriptor*             file
+    , std::set<const FileDescriptor*>*  modules
+    )
+  {
+    if(!modules->insert(file).second) {
+      return;
+    }
+    for(auto i=0; file->dependency_count() > i; ++i) {
+      CollectPbModules(file->dependency(i), modules);
+    }
+  }
+
+  std::string JsonString(const std::string& value) {
+    std::string result = "\"";
+    for(char c : value) {
+      if(c == '"' || c == '\\') {
+        result += '\\';
+      }
+      result += c;
+    }
+    return result + "\"";
+  }
+
+  struct OutputSize {
+    std::string filename;
+    int64_t bytes;
+  };
+
+  // Records the final size of a generated file once the generator releases
+  // its stream.
+  class CountingOutputStream : public ZeroCopyOutputStream {
+  private:
+    std::unique_ptr<ZeroCopyOutputStream> stream_;
+    OutputSize* size_;
+
+  public:
+    CountingOutputStream
+      ( ZeroCopyOutputStream*  stream
+      , OutputSize*            size
+      )
+      : stream_(stream)
+      , size_(size)
+    {
+    }
+
+    ~CountingOutputStream() override {
+      size_->bytes = stream_->ByteCount();
+    }
+
+    bool Next(void** data, int* size) override {
+      return stream_->Next(data, size);
+    }
+
+    void BackUp(int count) override {
+      stream_->BackUp(count);
+    }
+
+    int64_t ByteCount() const override {
+      return stream_->ByteCount();
+    }
+  };
+
+  // Passes files through to the real context, measuring each one.
+  class SizeReportContext : public GeneratorContext {
+  private:
+    GeneratorContext* context_;
+    std::deque<OutputSize> outputs_;
+
+  public:
+    explicit SizeReportContext
+      ( GeneratorContext* context
+      )
+      : context_(context)
+    {
+    }
+
+    const std::deque<OutputSize>& outputs() const {
+      return outputs_;
+    }
+
+    ZeroCopyOutputStream* Open
+      ( const std::string& filename
+      ) override
+    {
+      outputs_.push_back({filename, 0});
+      return new CountingOutputStream(
+        context_->Open(filename), &outputs_.back());
+    }
+
+    ZeroCopyOutputStream* OpenForInsert
+      ( const std::string& filename
+      , const std::string& insertionPoint
+      ) override
+    {
+      return context_->OpenForInsert(filename, insertionPoint);
+    }
+
+    void ListParsedFiles
+      ( std::vector<const FileDescriptor*>* output
+      ) override
+    {
+      context_->ListParsedFiles(output);
+    }
+  };
+}
+
+bool GrpcNodeGenerator::PrintServiceImplementationInterface
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&          options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  vars["ImplementationBase"] = ImplementationBase(options);
+
+  printer.Print(vars,
+    "export interface I$ServiceName$Implementation$ImplementationBase$ {\n");
+  printer.Indent();
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+    
+    PrintHandlerMember(printer, vars, method);
+  }
+
+  printer.Outdent();
+  printer.Print(vars, "}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceAsyncImplementation
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.asyncStreaming() || !HasServerStreamingMethod(service, false)) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  auto methodCount = service->method_count();
+
+  // Streaming responses are produced by async iterables; unary and client
+  // streaming handlers keep their callback signatures.
+  printer.Print(vars, "export interface I$ServiceName$AsyncImplementation {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(method->input_type());
+    vars["ResponseType"] = options.messageBackend().TypePath(method->output_type());
+    vars["ServerWritableStream"] = ServerCallType(options, method);
+
+    if(method->client_streaming() && method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (requests: AsyncIterable<$RequestType$>, "
+        "call: grpc.ServerDuplexStream<$RequestType$, $ResponseType$>) =>\n"
+        "  AsyncIterable<$ResponseType$>;\n");
+    } else
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (request: $RequestType$, "
+        "call: $ServerWritableStream$) =>\n"
+        "  AsyncIterable<$ResponseType$>;\n");
+    } else {
+      PrintHandlerMember(printer, vars, method);
+    }
+  }
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export function adapt$ServiceName$AsyncImplementation\n");
+  printer.Indent();
+  printer.Print(vars, "( implementation: I$ServiceName$AsyncImplementation\n");
+  printer.Print(vars, "): I$ServiceName$Implementation {\n");
+  printer.Print("return {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["RequestType"] = options.messageBackend().TypePath(method->input_type());
+    vars["ResponseType"] = options.messageBackend().TypePath(method->output_type());
+    vars["ServerWritableStream"] = ServerCallType(options, method);
+
+    if(method->client_streaming() && method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: grpc.ServerDuplexStream<$RequestType$, $ResponseType$>) =>\n"
+        "  grpcNodePumpStream(call, () =>\n"
+        "    implementation$methodAccessor$(grpcNodeReadRequests(call), call)),\n");
+    } else
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: $ServerWritableStream$) =>\n"
+        "  grpcNodePumpStream(call, () =>\n"
+        "    implementation$methodAccessor$(call.request, call)),\n");
+    } else {
+      printer.Print(vars,
+        "$methodName$: implementation$methodAccessor$,\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceDefinition
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&          options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  // For grpc-js the tables are frozen: every entry has the same shape and
+  // none of them can change after load.
+  vars["Freeze"] = options.grpcJs() ? "Object.freeze(" : "";
+  vars["FreezeEnd"] = options.grpcJs() ? ")" : "";
+
+  printer.Print(vars,
+    "export const $ServiceName$Service: "
+    "grpc.ServiceDefinition<I$ServiceName$Implementation> = $Freeze${\n");
+  printer.Indent();
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+    
+    printer.Print(vars,
+      "$methodName$: $Freeze$<grpc.MethodDefinition<$RequestType$, $ResponseType$>>");
+
+    if(!PrintServiceMethodDefinition(printer, options, method, error)) {
+      return false;
+    }
+
+    printer.Print(vars, "$FreezeEnd$,\n");
+  }
+
+  printer.Outdent();
+  printer.Print(vars, "}$FreezeEnd$\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceAdmission
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.admissionControl()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+  auto methodCount = service->method_count();
+
+  // Every method is listed, so limits can also be set at runtime.
+  printer.Print(vars, "export const $ServiceName$AdmissionPolicy = {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    grpc_node::MethodPolicy policy;
+    if(!GetServiceConfigPolicy(method, &policy, error)) {
+      return false;
+    }
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["maxConcurrent"] = policy.has_max_concurrent_calls() ?
+      std::to_string(policy.max_concurrent_calls()) : "Infinity";
+    vars["maxQueued"] = std::to_string(policy.max_queued_calls());
+    vars["priority"] = std::to_string(AdmissionPriority(method));
+    printer.Print(vars,
+      "$methodName$: { maxConcurrent: $maxConcurrent$, "
+      "maxQueued: $maxQueued$, priority: $priority$ },\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  printer.Print(vars,
+    "export interface I$ServiceName$AdmissionConfig {\n"
+    "  // Replace $ServiceName$AdmissionPolicy limits, keyed by method\n"
+    "  methods?: { [method: string]: { maxConcurrent?: number, "
+    "maxQueued?: number } | undefined };\n"
+    "  // Bound on the calls queued by all methods together\n"
+    "  maxQueuedTotal?: number;\n"
+    "  onShed?: (method: string) => void;\n"
+    "}\n\n");
+
+  printer.Print(vars, "export function admit$ServiceName$Implementation\n");
+  printer.Indent();
+  printer.Print(vars,
+    "( implementation: I$ServiceName$Implementation\n"
+    ", config: I$ServiceName$AdmissionConfig = {}\n"
+    "): I$ServiceName$Implementation {\n"
+    "const admission = new GrpcNodeAdmission("
+    "$ServiceName$AdmissionPolicy, config);\n"
+    "return {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodKey"] = utils::lowercaseFirstLetter(method->name());
+    vars["methodAccessor"] = GetMethodAccessor(method);
+
+    // Streaming responses end with the stream; unary ones with the callback.
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: any) => admission.admit('$methodKey$', call,\n"
+        "  release => {\n"
+        "    call.on('finish', release);\n"
+        "    call.on('error', release);\n"
+        "    implementation$methodAccessor$(call);\n"
+        "  },\n"
+        "  error => call.emit('error', error)),\n");
+    } else {
+      printer.Print(vars,
+        "$methodName$: (call: any, callback: any) => "
+        "admission.admit('$methodKey$', call,\n"
+        "  release => implementation$methodAccessor$(call,\n"
+        "    (error: any, ...rest: any[]) => {\n"
+        "      release();\n"
+        "      callback(error, ...rest);\n"
+        "    }),\n"
+        "  error => callback(error)),\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintMessageTransformer
+  ( google::protobuf::io::Printer&       printer
+  , const GrpcNodeGeneratorOptions&      options
+  , const google::protobuf::Descriptor*  descriptor
+  , std::string*                         error
+  , GrpcNodeModuleStats*                 stats
+  ) const
+{
+  if(stats != nullptr) {
+    ++stats->transformers;
+  }
+
+  std::map<std::string, std::string> vars;
+  std::string fullName = descriptor->full_name();
+  vars["identifierName"] = utils::messageIdentifierName(fullName);
+  vars["name"] = fullName;
+  vars["NodeName"] = options.messageBackend().TypePath(descriptor);
+
+  // Print the serializer
+  // grpc-js checks the codecs against its Serialize/Deserialize types.
+  vars["SerializedType"] = options.grpcJs() ? "Buffer" : "any";
+  vars["DeserializedType"] = options.grpcJs() ? vars["NodeName"] : "any";
+
+  printer.Print(vars,
+    "function serialize_$identifierName$"
+    "(arg: $NodeName$): $SerializedType$ {\n");
+  printer.Indent();
+  // printer.Print(vars, "if (!(arg instanceof $NodeName$)) {\n");
+  // printer.Indent();
+  // printer.Print(vars, "throw new Error('Expected argument of type $name$');\n");
+  // printer.Outdent();
+  // printer.Print("}\n");
+  // printer.Print("console.trace(arg);\n");
+  options.messageBackend().PrintSerializerBody(printer, vars["NodeName"]);
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  // Print the deserializer
+  printer.Print(vars,
+    "function deserialize_$identifierName$"
+    "(buffer_arg: $SerializedType$): $DeserializedType$ {\n");
+  printer.Indent();
+  options.messageBackend().PrintDeserializerBody(printer, vars["NodeName"]);
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  if(options.isOffloaded(fullName)) {
+    // Large payloads are decoded on the worker pool and rebuilt from a
+    // cloneable form without parsing them again.
+    vars["FromCloneable"] = options.messageBackend().FromCloneableExpression(
+      vars["NodeName"], "value");
+    printer.Print(vars,
+      "function deserializeAsync_$identifierName$"
+      "(buffer_arg: Buffer): Promise<$NodeName$> {\n");
+    printer.Indent();
+    printer.Print(vars,
+      "if (buffer_arg.length < GRPC_NODE_OFFLOAD_THRESHOLD) {\n"
+      "  return Promise.resolve(deserialize_$identifierName$(buffer_arg));\n"
+      "}\n"
+      "return grpcNodeDeserializePool.decode('$name$', buffer_arg)\n"
+      "  .then(value => $FromCloneable$);\n");
+    printer.Outdent();
+    printer.Print("}\n\n");
+  }
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceMethodDefinition
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::MethodDescriptor*   method
+  , std::string*                                error
+  ) const
+{
+  const Descriptor* inputType = method->input_type();
+  const Descriptor* outputType = method->output_type();
+  std::map<std::string, std::string> vars;
+  vars["ServiceFullName"] = method->service()->full_name();
+  vars["MethodName"] = method->name();
+  vars["inputType"] = options.messageBackend().TypePath(inputType);
+  vars["inputTypeId"] = utils::messageIdentifierName(inputType->full_name());
+  vars["outputType"] = options.messageBackend().TypePath(outputType);
+  vars["outputTypeId"] = utils::messageIdentifierName(outputType->full_name());
+  vars["isClientStream"] = method->client_streaming() ? "true" : "false";
+  vars["isServerStream"] = method->server_streaming() ? "true" : "false";
+  printer.Print("{\n");
+  printer.Indent();
+  printer.Print(vars, "path: '/$ServiceFullName$/$MethodName$',\n");
+  printer.Print(vars, "requestStream: $isClientStream$,\n");
+  printer.Print(vars, "responseStream: $isServerStream$,\n");
+  printer.Print(vars, "requestType: $inputType$,\n");
+  printer.Print(vars, "responseType: $outputType$,\n");
+  printer.Print(vars, "requestSerialize: serialize_$inputTypeId$,\n");
+  // Messages checked by limit<Service>Implementation are measured while
+  // they are decoded or encoded anyway.
+  auto limits = GetServerMessageSizeLimits(method->service());
+  if(HasHandlerRequestLimit(method, limits)) {
+    printer.Print(vars,
+      "requestDeserialize: grpcNodeMeasureReceived(deserialize_$inputTypeId$),\n");
+  } else {
+    printer.Print(vars, "requestDeserialize: deserialize_$inputTypeId$,\n");
+  }
+  if(HasHandlerResponseLimit(method, limits)) {
+    printer.Print(vars,
+      "responseSerialize: grpcNodeReuseEncoded(serialize_$outputTypeId$),\n");
+  } else {
+    printer.Print(vars, "responseSerialize: serialize_$outputTypeId$,\n");
+  }
+  printer.Print(vars, "responseDeserialize: deserialize_$outputTypeId$,\n");
+  printer.Outdent();
+  printer.Print("}");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServicePooledClient
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.pooledClient()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  printer.Print(vars,
+    "export interface $ServiceName$PooledClientConstructor {\n");
+  printer.Indent();
+  printer.Print(vars, "new\n");
+  printer.Indent();
+  printer.Print(vars, "( address: string\n");
+  printer.Print(vars, ", credentials: grpc.ChannelCredentials\n");
+  printer.Print(vars, ", poolSize: number\n");
+  printer.Print(vars, ", options?: object\n");
+  printer.Print(vars, ", strategy?: 'least_loaded' | 'round_robin'\n");
+  printer.Print(vars, "): I$ServiceName$Client;\n");
+  printer.Outdent();
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export const $ServiceName$PooledClient = "
+    "<$ServiceName$PooledClientConstructor><any>function\n");
+  printer.Indent();
+  printer.Print(vars, "( address: string\n");
+  printer.Print(vars, ", credentials: grpc.ChannelCredentials\n");
+  printer.Print(vars, ", poolSize: number\n");
+  printer.Print(vars, ", options?: object\n");
+  printer.Print(vars, ", strategy?: 'least_loaded' | 'round_robin'\n");
+  printer.Print(vars, ") {\n");
+  printer.Print(vars, "return grpcNodePooledClient(\n");
+  printer.Indent();
+  printer.Print(vars,
+    "$ServiceName$Client, Object.keys($ServiceName$Service),\n"
+    "address, credentials, poolSize, options, strategy);\n");
+  printer.Outdent();
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceInProcessClient
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.inProcess()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  printer.Print(vars, "export function create$ServiceName$InProcessClient\n");
+  printer.Indent();
+  printer.Print(vars, "( implementation: I$ServiceName$Implementation\n");
+  printer.Print(vars, ", options: { cloneMessages?: boolean } = {}\n");
+  printer.Print(vars, "): I$ServiceName$Client {\n");
+  printer.Print(vars,
+    "return grpcNodeInProcessClient("
+    "$ServiceName$Service, implementation, options);\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServicePassthrough
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.passthrough()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()},
+    {"RequestType", "Buffer"},
+    {"ResponseType", "Buffer"},
+    {"Freeze", options.grpcJs() ? "Object.freeze(" : ""},
+    {"FreezeEnd", options.grpcJs() ? ")" : ""}
+  };
+
+  auto methodCount = service->method_count();
+
+  vars["ImplementationBase"] = ImplementationBase(options);
+
+  printer.Print(vars,
+    "export interface I$ServiceName$PassthroughImplementation"
+    "$ImplementationBase$ {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    PrintHandlerMember(printer, vars, method);
+  }
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export const $ServiceName$PassthroughService: "
+    "grpc.ServiceDefinition<I$ServiceName$PassthroughImplementation> = "
+    "$Freeze${\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["MethodName"] = method->name();
+    vars["isClientStream"] = method->client_streaming() ? "true" : "false";
+    vars["isServerStream"] = method->server_streaming() ? "true" : "false";
+
+    printer.Print(vars,
+      "$methodName$: $Freeze$<grpc.MethodDefinition<Buffer, Buffer>>{\n");
+    printer.Indent();
+    printer.Print(vars, "path: '/$ServiceFullName$/$MethodName$',\n");
+    printer.Print(vars, "requestStream: $isClientStream$,\n");
+    printer.Print(vars, "responseStream: $isServerStream$,\n");
+    printer.Print(vars, "requestSerialize: grpcNodeIdentity,\n");
+    printer.Print(vars, "requestDeserialize: grpcNodeIdentity,\n");
+    printer.Print(vars, "responseSerialize: grpcNodeIdentity,\n");
+    printer.Print(vars, "responseDeserialize: grpcNodeIdentity,\n");
+    printer.Outdent();
+    printer.Print(vars, "}$FreezeEnd$,\n");
+  }
+  printer.Outdent();
+  printer.Print(vars, "}$FreezeEnd$\n\n");
+
+  printer.Print(vars,
+    "export interface I$ServiceName$PassthroughClient extends grpc.Client {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    PrintClientMethodOverloads(printer, vars, method);
+  }
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export interface $ServiceName$PassthroughClientConstructor {\n");
+  printer.Indent();
+  printer.Print(vars, "new ("
+    "address: string, "
+    "credentials: grpc.ChannelCredentials, "
+    "options?: object"
+    "): I$ServiceName$PassthroughClient;\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export const $ServiceName$PassthroughClient = "
+    "<$ServiceName$PassthroughClientConstructor>\n");
+  printer.Indent();
+  printer.Print(vars,
+    "grpc.makeGenericClientConstructor("
+      "$ServiceName$PassthroughService, '$ServiceFullName$', {});\n\n");
+  printer.Outdent();
+
+  // Typed codecs so a proxy can decode the few messages it needs to inspect.
+  printer.Print(vars, "export const $ServiceName$PassthroughCodec = {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+    vars["inputTypeId"] = utils::messageIdentifierName(inputType->full_name());
+    vars["outputTypeId"] = utils::messageIdentifierName(outputType->full_name());
+
+    printer.Print(vars, "$methodName$: {\n");
+    printer.Indent();
+    printer.Print(vars,
+      "decodeRequest: (buffer: Buffer): $RequestType$ =>\n"
+      "  deserialize_$inputTypeId$(buffer),\n"
+      "encodeRequest: (message: $RequestType$): Buffer =>\n"
+      "  serialize_$inputTypeId$(message),\n"
+      "decodeResponse: (buffer: Buffer): $ResponseType$ =>\n"
+      "  deserialize_$outputTypeId$(buffer),\n"
+      "encodeResponse: (message: $ResponseType$): Buffer =>\n"
+      "  serialize_$outputTypeId$(message),\n");
+    printer.Outdent();
+    printer.Print("},\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceOffload
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  auto methodCount = service->method_count();
+
+  bool hasOffloadedMethod = false;
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    hasOffloadedMethod = hasOffloadedMethod ||
+      IsOffloadedRequest(options, method) ||
+      IsOffloadedResponse(options, method);
+  }
+
+  if(!hasOffloadedMethod) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()},
+    {"worker", GetBasename(GetOffloadWorkerFilename(service->file()))}
+  };
+
+  // Same definition, but offloaded messages are handed over undecoded.
+  printer.Print(vars,
+    "export const $ServiceName$OffloadService: "
+    "grpc.ServiceDefinition<any> = {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    printer.Print(vars, "$methodName$: {\n");
+    printer.Indent();
+    printer.Print(vars, "...$ServiceName$Service$methodAccessor$,\n");
+    if(IsOffloadedRequest(options, method)) {
+      printer.Print("requestDeserialize: (buffer: Buffer) => buffer,\n");
+    }
+    if(IsOffloadedResponse(options, method)) {
+      printer.Print("responseDeserialize: (buffer: Buffer) => buffer,\n");
+    }
+    printer.Outdent();
+    printer.Print("},\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  printer.Print(vars,
+    "// Points the offload pool at its worker module, for builds that do not\n"
+    "// keep $worker$.js next to this module, such as bundles. Required\n"
+    "// when this module is loaded as an ES module, e.g. with\n"
+    "// new URL('./$worker$.js', import.meta.url).\n"
+    "export function set$ServiceName$OffloadWorker(filename: string | URL): void {\n"
+    "  grpcNodeDeserializePool.workerFilename = () => filename;\n"
+    "}\n\n");
+
+  // Server side: decode the request, then call the regular handler.
+  printer.Print(vars,
+    "export function adapt$ServiceName$OffloadImplementation\n");
+  printer.Indent();
+  printer.Print(vars, "( implementation: I$ServiceName$Implementation\n");
+  printer.Print(vars, "): { [name: string]: (call: any, callback?: any) => void } {\n");
+  printer.Print("return {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["inputTypeId"] = utils::messageIdentifierName(
+      method->input_type()->full_name());
+
+    if(!IsOffloadedRequest(options, method)) {
+      printer.Print(vars,
+        "$methodName$: (call: any, callback?: any) =>\n"
+        "  implementation$methodAccessor$(call, callback),\n");
+    } else
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: any) => {\n"
+        "  deserializeAsync_$inputTypeId$(call.request).then(request => {\n"
+        "    call.request = request;\n"
+        "    implementation$methodAccessor$(call);\n"
+        "  }, error => call.emit('error', {\n"
+        "    code: grpc.status.INTERNAL, details: String(error) }));\n"
+        "},\n");
+    } else {
+      printer.Print(vars,
+        "$methodName$: (call: any, callback: any) => {\n"
+        "  deserializeAsync_$inputTypeId$(call.request).then(request => {\n"
+        "    call.request = request;\n"
+        "    implementation$methodAccessor$(call, callback);\n"
+        "  }, error => callback({\n"
+        "    code: grpc.status.INTERNAL, details: String(error) }));\n"
+        "},\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  // Client side: a promise client decoding responses off the event loop.
+  printer.Print(vars,
+    "const $ServiceName$OffloadClientBase =\n"
+    "  grpc.makeGenericClientConstructor("
+    "$ServiceName$OffloadService, '$ServiceFullName$', {});\n\n");
+
+  printer.Print(vars,
+    "export class $ServiceName$OffloadPromiseClient "
+    "implements I$ServiceName$PromiseClient {\n");
+  printer.Indent();
+  printer.Print("private readonly client: any;\n\n");
+  printer.Print(vars,
+    "constructor"
+    "(address: string, credentials: grpc.ChannelCredentials, options?: object) {\n"
+    "  this.client = new $ServiceName$OffloadClientBase(address, credentials, options);\n"
+    "}\n\n"
+    "close(): void {\n"
+    "  this.client.close();\n"
+    "}\n");
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    if(utils::getMethodType(method) != utils::METHODTYPE_NO_STREAMING) {
+      continue;
+    }
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["RequestType"] = options.messageBackend().TypePath(method->input_type());
+    vars["ResponseType"] = options.messageBackend().TypePath(method->output_type());
+    vars["outputTypeId"] = utils::messageIdentifierName(
+      method->output_type()->full_name());
+
+    printer.Print("\n");
+    printer.Print(vars, "$methodName$\n");
+    printer.Indent();
+    printer.Print(vars, "( request: $RequestType$\n");
+    printer.Print(vars, ", metadata?: grpc.Metadata | null\n");
+    printer.Print(vars, ", options?: grpc.CallOptions | null\n");
+    printer.Print(vars, "): Promise<$ResponseType$> {\n");
+    printer.Print(vars,
+      "return new Promise<any>((resolve, reject) => this.client$methodAccessor$(\n"
+      "  request, metadata || new grpc.Metadata(), options || {},\n"
+      "  (err: grpc.ServiceError | null, response: any) =>\n"
+      "    err ? reject(err) : resolve(response)))");
+    if(IsOffloadedResponse(options, method)) {
+      printer.Print(vars,
+        "\n  .then(response => deserializeAsync_$outputTypeId$(response));\n");
+    } else {
+      printer.Print(";\n");
+    }
+    printer.Outdent();
+    printer.Print("}\n");
+  }
+
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceCallContext
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.deadlinePropagation()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  // Every service exports the same structural type, so a context received
+  // by one service's handler can be passed to any other service's client.
+  printer.Print(vars,
+    "export interface I$ServiceName$CallContext {\n"
+    "  readonly deadline: Date | undefined;\n"
+    "  readonly isCancelled: boolean;\n"
+    "  remainingMs(): number;\n"
+    "  onCancel(listener: () => void): void;\n"
+    "  callOptions(options?: grpc.CallOptions): grpc.CallOptions;\n"
+    "}\n\n");
+
+  printer.Print(vars,
+    "// A context for calls that do not originate from an inbound call, e.g.\n"
+    "// to bound a whole request fan-out by one deadline.\n"
+    "export function create$ServiceName$CallContext\n"
+    "  ( deadline?: Date | number\n"
+    "  , marginMs?: number\n"
+    "  ): I$ServiceName$CallContext & { cancel(): void } {\n"
+    "  return new GrpcNodeCallContext(undefined, deadline, marginMs);\n"
+    "}\n\n");
+
+  auto methodCount = service->method_count();
+
+  vars["ImplementationBase"] = ImplementationBase(options);
+  printer.Print(vars,
+    "export interface I$ServiceName$ContextImplementation"
+    "$ImplementationBase$ {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["ResponseType"] =
+      options.messageBackend().TypePath(method->output_type());
+    vars["CallType"] = ServerCallType(options, method);
+
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: $CallType$,\n"
+        "  context: I$ServiceName$CallContext) => void;\n");
+    } else {
+      printer.Print(vars,
+        "$methodName$: (call: $CallType$,\n"
+        "  callback: grpc.sendUnaryData<$ResponseType$>,\n"
+        "  context: I$ServiceName$CallContext) => void;\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export function adapt$ServiceName$ContextImplementation\n");
+  printer.Indent();
+  printer.Print(vars,
+    "( implementation: I$ServiceName$ContextImplementation\n");
+  printer.Print(vars, "): I$ServiceName$Implementation {\n");
+  printer.Print("return {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+
+    if(method->server_streaming()) {
+      printer.Print(vars,
+        "$methodName$: (call: any) =>\n"
+        "  implementation$methodAccessor$(call, new GrpcNodeCallContext(call)),\n");
+    } else {
+      printer.Print(vars,
+        "$methodName$: (call: any, callback: any) =>\n"
+        "  implementation$methodAccessor$(call, callback, "
+        "new GrpcNodeCallContext(call)),\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  // Client: the context goes first; a null context makes a plain call.
+  printer.Print(vars, "export class $ServiceName$ContextClient {\n");
+  printer.Indent();
+  printer.Print(vars,
+    "constructor(private readonly client: I$ServiceName$Client) {}\n");
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["RequestType"] =
+      options.messageBackend().TypePath(method->input_type());
+    vars["ResponseType"] =
+      options.messageBackend().TypePath(method->output_type());
+
+    printer.Print("\n");
+    printer.Print(vars, "$methodName$\n");
+    printer.Indent();
+    printer.Print(vars, "( context: I$ServiceName$CallContext | null\n");
+
+    switch(utils::getMethodType(method)) {
+      case utils::METHODTYPE_NO_STREAMING:
+        printer.Print(vars,
+          ", request: $RequestType$\n"
+          ", metadata?: grpc.Metadata | null\n"
+          ", options?: grpc.CallOptions | null\n"
+          "): Promise<$ResponseType$> {\n"
+          "return new Promise<$ResponseType$>((resolve, reject) =>\n"
+          "  grpcNodeCallWithContext(context, options, callOptions =>\n"
+          "    (<any>this.client)$methodAccessor$(\n"
+          "      request, metadata || new grpc.Metadata(), callOptions,\n"
+          "      (err: grpc.ServiceError | null, response: $ResponseType$) =>\n"
+          "        err ? reject(err) : resolve(response))));\n");
+        break;
+      case utils::METHODTYPE_SERVER_STREAMING:
+        printer.Print(vars,
+          ", request: $RequestType$\n"
+          ", metadata?: grpc.Metadata | null\n"
+          ", options?: grpc.CallOptions | null\n"
+          "): grpc.ClientReadableStream<$ResponseType$> {\n"
+          "return grpcNodeCallWithContext(context, options, callOptions =>\n"
+          "  (<any>this.client)$methodAccessor$(\n"
+          "    request, metadata || new grpc.Metadata(), callOptions));\n");
+        break;
+      case utils::METHODTYPE_CLIENT_STREAMING:
+        printer.Print(vars,
+          ", callback: grpc.requestCallback<$ResponseType$>\n"
+          ", metadata?: grpc.Metadata | null\n"
+          ", options?: grpc.CallOptions | null\n"
+          "): grpc.ClientWritableStream<$RequestType$> {\n"
+          "return grpcNodeCallWithContext(context, options, callOptions =>\n"
+          "  (<any>this.client)$methodAccessor$(\n"
+          "    metadata || new grpc.Metadata(), callOptions, callback));\n");
+        break;
+      case utils::METHODTYPE_BIDI_STREAMING:
+        printer.Print(vars,
+          ", metadata?: grpc.Metadata | null\n"
+          ", options?: grpc.CallOptions | null\n"
+          "): grpc.ClientDuplexStream<$RequestType$, $ResponseType$> {\n"
+          "return grpcNodeCallWithContext(context, options, callOptions =>\n"
+          "  (<any>this.client)$methodAccessor$(\n"
+          "    metadata || new grpc.Metadata(), callOptions));\n");
+        break;
+    }
+
+    printer.Outdent();
+    printer.Print("}\n");
+  }
+
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceChunked
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::vector<std::pair<const MethodDescriptor*, grpc_node::ChunkedTransfer>>
+    chunked;
+
+  for(auto i=0; service->method_count() > i; ++i) {
+    auto method = service->method(i);
+    grpc_node::ChunkedTransfer transfer;
+    if(!utils::getChunkedTransfer(method, &transfer)) {
+      continue;
+    }
+
+    const std::string& name = method->full_name();
+    if(utils::getMethodType(method) != utils::METHODTYPE_NO_STREAMING) {
+      *error = name + ": chunked_transfer is only supported on unary methods";
+      return false;
+    }
+    if(transfer.chunk_bytes() == 0) {
+      *error = name + ": chunked_transfer.chunk_bytes must be positive";
+      return false;
+    }
+    if(GetChunkedFields(method->input_type()).empty() &&
+       GetChunkedFields(method->output_type()).empty()) {
+      *error = name + ": chunked_transfer needs a bytes or repeated field in "
+        "the request or response";
+      return false;
+    }
+    if(service->FindMethodByName(method->name() + "Chunked") != nullptr) {
+      *error = name + ": chunked_transfer companion " + method->name() +
+        "Chunked clashes with a method of the service";
+      return false;
+    }
+
+    chunked.emplace_back(method, transfer);
+  }
+
+  if(chunked.empty()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()},
+    {"ImplementationBase", ImplementationBase(options)},
+    {"Freeze", options.grpcJs() ? "Object.freeze(" : ""},
+    {"FreezeEnd", options.grpcJs() ? ")" : ""}
+  };
+
+  auto setMethodVars = [&](
+    const MethodDescriptor* method,
+    const grpc_node::ChunkedTransfer& transfer
+  ) {
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["chunkedName"] =
+      utils::lowercaseFirstLetter(method->name()) + "Chunked";
+    vars["MethodName"] = method->name();
+    vars["RequestType"] =
+      options.messageBackend().TypePath(method->input_type());
+    vars["ResponseType"] =
+      options.messageBackend().TypePath(method->output_type());
+    vars["inputTypeId"] =
+      utils::messageIdentifierName(method->input_type()->full_name());
+    vars["outputTypeId"] =
+      utils::messageIdentifierName(method->output_type()->full_name());
+    vars["chunkBytes"] = std::to_string(transfer.chunk_bytes());
+  };
+
+  // The companion service streams the chunks of each marked method both
+  // ways under a separate path, so servers keep serving the unary method.
+  printer.Print(vars,
+    "export interface I$ServiceName$ChunkedImplementation"
+    "$ImplementationBase$ {\n");
+  printer.Indent();
+  for(const auto& entry : chunked) {
+    setMethodVars(entry.first, entry.second);
+    printer.Print(vars,
+      "$chunkedName$: grpc.handleBidiStreamingCall<"
+      "$RequestType$, $ResponseType$>;\n");
+  }
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "export const $ServiceName$ChunkedService: "
+    "grpc.ServiceDefinition<I$ServiceName$ChunkedImplementation> = "
+    "$Freeze${\n");
+  printer.Indent();
+  for(const auto& entry : chunked) {
+    setMethodVars(entry.first, entry.second);
+    printer.Print(vars,
+      "$chunkedName$: $Freeze$"
+      "<grpc.MethodDefinition<$RequestType$, $ResponseType$>>{\n"
+      "  path: '/$ServiceFullName$/$MethodName$Chunked',\n"
+      "  requestStream: true,\n"
+      "  responseStream: true,\n"
+      "  requestType: $RequestType$,\n"
+      "  responseType: $ResponseType$,\n"
+      "  requestSerialize: serialize_$inputTypeId$,\n"
+      "  requestDeserialize: deserialize_$inputTypeId$,\n"
+      "  responseSerialize: serialize_$outputTypeId$,\n"
+      "  responseDeserialize: deserialize_$outputTypeId$,\n"
+      "}$FreezeEnd$,\n");
+  }
+  printer.Outdent();
+  printer.Print(vars, "}$FreezeEnd$\n\n");
+
+  printer.Print(vars,
+    "export function adapt$ServiceName$ChunkedImplementation\n");
+  printer.Indent();
+  printer.Print(vars,
+    "( implementation: I$ServiceName$Implementation\n"
+    "): I$ServiceName$ChunkedImplementation {\n"
+    "return {\n");
+  printer.Indent();
+  for(const auto& entry : chunked) {
+    setMethodVars(entry.first, entry.second);
+    printer.Print(vars,
+      "$chunkedName$: (call: any) => grpcNodeServeChunked(call,\n"
+      "  new GrpcNodeAssembler_$inputTypeId$(),\n"
+      "  implementation$methodAccessor$,\n"
+      "  (response: $ResponseType$) =>\n"
+      "    grpcNodeChunk_$outputTypeId$(response, $chunkBytes$)),\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(vars,
+    "const $ServiceName$ChunkedGenericClient = grpc.makeGenericClientConstructor(\n"
+    "  $ServiceName$ChunkedService, '$ServiceFullName$Chunked', {});\n\n");
+
+  printer.Print(vars, "export class $ServiceName$ChunkedClient {\n");
+  printer.Indent();
+  printer.Print(vars,
+    "private readonly client: any;\n"
+    "\n"
+    "constructor\n"
+    "  ( address: string\n"
+    "  , credentials: grpc.ChannelCredentials\n"
+    "  , options?: object\n"
+    "  ) {\n"
+    "  this.client = new $ServiceName$ChunkedGenericClient(\n"
+    "    address, credentials, options);\n"
+    "}\n");
+
+  for(const auto& entry : chunked) {
+    setMethodVars(entry.first, entry.second);
+    printer.Print(vars,
+      "\n"
+      "// Chunks of about $chunkBytes$ bytes both ways\n"
+      "$methodName$\n"
+      "  ( request: $RequestType$\n"
+      "  , metadata?: grpc.Metadata | null\n"
+      "  , options?: grpc.CallOptions | null\n"
+      "  ): Promise<$ResponseType$> {\n"
+      "  return grpcNodeChunkedCall(\n"
+      "    this.client.$chunkedName$(\n"
+      "      metadata || new grpc.Metadata(), options || {}),\n"
+      "    grpcNodeChunk_$inputTypeId$(request, $chunkBytes$),\n"
+      "    new GrpcNodeAssembler_$outputTypeId$());\n"
+      "}\n");
+  }
+
+  printer.Print(
+    "\n"
+    "close(): void {\n"
+    "  this.client.close();\n"
+    "}\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServicePromiseClientInterface
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&          options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  printer.Print(vars, "export interface I$ServiceName$PromiseClient {\n");
+  printer.Indent();
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+
+    if(method->client_streaming() && method->server_streaming()) {
+
+    } else
+    if(method->client_streaming()) {
+
+    } else
+    if(method->server_streaming()) {
+
+    } else {
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, "): Promise<$ResponseType$>;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
+      printer.Print(vars, "): Promise<$ResponseType$>;\n");
+      printer.Outdent();
+
+      printer.Print(vars, "$methodName$\n");
+      printer.Indent();
+      printer.Print(vars, "( request: $RequestType$\n");
+      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
+      printer.Print(vars, ", options: grpc.CallOptions | null\n");
+      printer.Print(vars, "): Promise<$ResponseType$>;\n\n");
+      printer.Outdent();
+    }
+  }
+
+  printer.Outdent();
+  printer.Print(vars, "}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceConfig
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::vector<std::pair<const MethodDescriptor*, grpc_node::MethodPolicy>>
+    entries;
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    grpc_node::MethodPolicy policy;
+    if(!GetServiceConfigPolicy(method, &policy, error)) {
+      return false;
+    }
+    if(HasServiceConfigEntry(policy)) {
+      entries.emplace_back(method, policy);
+    }
+  }
+
+  if(entries.empty()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()}
+  };
+
+  printer.Print(vars,
+    "export const $ServiceName$ServiceConfig: GrpcNodeServiceConfig = {\n");
+  printer.Indent();
+  printer.Print("methodConfig: [\n");
+  printer.Indent();
+
+  for(const auto& entry : entries) {
+    const auto& policy = entry.second;
+    vars["MethodName"] = entry.first->name();
+
+    printer.Print("{\n");
+    printer.Indent();
+    printer.Print(vars,
+      "name: [{ service: '$ServiceFullName$', method: '$MethodName$' }],\n");
+
+    if(policy.has_timeout()) {
+      printer.Print("timeout: '$timeout$',\n",
+        "timeout", utils::durationString(policy.timeout()));
+    }
+
+    if(policy.has_wait_for_ready()) {
+      printer.Print("waitForReady: $waitForReady$,\n",
+        "waitForReady", policy.wait_for_ready() ? "true" : "false");
+    }
+
+    if(policy.has_max_request_message_bytes()) {
+      printer.Print("maxRequestMessageBytes: $bytes$,\n",
+        "bytes", std::to_string(policy.max_request_message_bytes()));
+    }
+
+    if(policy.has_max_response_message_bytes()) {
+      printer.Print("maxResponseMessageBytes: $bytes$,\n",
+        "bytes", std::to_string(policy.max_response_message_bytes()));
+    }
+
+    if(policy.has_retry_policy()) {
+      const auto& retry = policy.retry_policy();
+      printer.Print("retryPolicy: {\n");
+      printer.Indent();
+      printer.Print("maxAttempts: $maxAttempts$,\n",
+        "maxAttempts", std::to_string(retry.max_attempts()));
+      printer.Print("initialBackoff: '$initialBackoff$',\n",
+        "initialBackoff", utils::durationString(retry.initial_backoff()));
+      printer.Print("maxBackoff: '$maxBackoff$',\n",
+        "maxBackoff", utils::durationString(retry.max_backoff()));
+      std::ostringstream multiplier;
+      multiplier << retry.backoff_multiplier();
+      printer.Print("backoffMultiplier: $backoffMultiplier$,\n",
+        "backoffMultiplier", multiplier.str());
+      printer.Print("retryableStatusCodes: $codes$,\n",
+        "codes", StatusCodeList(retry.retryable_status_codes()));
+      printer.Outdent();
+      printer.Print("},\n");
+    }
+
+    if(policy.has_hedging_policy()) {
+      const auto& hedging = policy.hedging_policy();
+      printer.Print("hedgingPolicy: {\n");
+      printer.Indent();
+      printer.Print("maxAttempts: $maxAttempts$,\n",
+        "maxAttempts", std::to_string(hedging.max_attempts()));
+      if(hedging.has_hedging_delay()) {
+        printer.Print("hedgingDelay: '$hedgingDelay$',\n",
+          "hedgingDelay", utils::durationString(hedging.hedging_delay()));
+      }
+      if(hedging.non_fatal_status_codes_size() > 0) {
+        printer.Print("nonFatalStatusCodes: $codes$,\n",
+          "codes", StatusCodeList(hedging.non_fatal_status_codes()));
+      }
+      printer.Outdent();
+      printer.Print("},\n");
+    }
+
+    printer.Outdent();
+    printer.Print("},\n");
+  }
+
+  printer.Outdent();
+  printer.Print("],\n");
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceCachingClient
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!options.cachingClient() || !HasCacheableMethod(service)) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()}
+  };
+
+  // Cached responses are shared between callers and must not be mutated.
+  printer.Print(vars,
+    "// Responses are cached per request and per caller key. Metadata and\n"
+    "// call options usually carry the caller's identity, so by default a\n"
+    "// call that passes either bypasses the cache; pass `keyFor` to cache\n"
+    "// those calls under the key it returns (undefined bypasses the cache).\n"
+    "export class $ServiceName$CachingClient "
+    "implements I$ServiceName$PromiseClient {\n");
+  printer.Indent();
+  printer.Print("private readonly cache: GrpcNodeResponseCache;\n");
+  printer.Print(
+    "private readonly keyFor: GrpcNodeCacheKeyFor;\n\n");
+  printer.Print(vars, "constructor\n");
+  printer.Indent();
+  printer.Print(vars, "( private readonly client: I$ServiceName$Client\n");
+  printer.Print(vars,
+    ", options: { maxEntries?: number, ttlMs?: number, "
+    "keyFor?: GrpcNodeCacheKeyFor } = {}\n");
+  printer.Print(vars, ") {\n");
+  printer.Print(vars, "this.cache = new GrpcNodeResponseCache(\n");
+  printer.Indent();
+  printer.Print(
+    "options.maxEntries !== undefined ? options.maxEntries : 1000,\n"
+    "options.ttlMs !== undefined ? options.ttlMs : 1000);\n");
+  printer.Outdent();
+  printer.Print(
+    "this.keyFor = options.keyFor ||\n"
+    "  ((metadata, options) => metadata || options ? undefined : '');\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  printer.Print(
+    "stats(): { hits: number, misses: number, deduplicated: number, "
+    "size: number } {\n");
+  printer.Indent();
+  printer.Print("const { hits, misses, deduplicated, size } = this.cache;\n");
+  printer.Print("return { hits, misses, deduplicated, size };\n");
+  printer.Outdent();
+  printer.Print("}\n");
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    if(utils::getMethodType(method) != utils::METHODTYPE_NO_STREAMING) {
+      continue;
+    }
+
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["MethodName"] = method->name();
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+    vars["inputTypeId"] = utils::messageIdentifierName(inputType->full_name());
+
+    printer.Print("\n");
+    printer.Print(vars, "$methodName$\n");
+    printer.Indent();
+    printer.Print(vars, "( request: $RequestType$\n");
+    printer.Print(vars, ", metadata?: grpc.Metadata | null\n");
+    printer.Print(vars, ", options?: grpc.CallOptions | null\n");
+    printer.Print(vars, "): Promise<$ResponseType$> {\n");
+    printer.Print(vars, "const call = () => new Promise<$ResponseType$>(\n");
+    printer.Indent();
+    printer.Print(vars, "(resolve, reject) => this.client$methodAccessor$(\n");
+    printer.Indent();
+    printer.Print(vars,
+      "request, metadata || new grpc.Metadata(), options || {},\n"
+      "(err, response) => err ? reject(err) : resolve(<$ResponseType$>response)));\n");
+    printer.Outdent();
+    printer.Outdent();
+
+    if(IsCacheable(method)) {
+      // The caller key is length-prefixed so it cannot run into the path.
+      printer.Print("const scope = this.keyFor(metadata, options);\n");
+      printer.Print("if (scope === undefined) {\n");
+      printer.Print("  return call();\n");
+      printer.Print("}\n");
+      printer.Print(vars,
+        "const key = scope.length + ':' + scope + "
+        "'/$ServiceFullName$/$MethodName$\\0' +\n");
+      printer.Indent();
+      printer.Print(vars,
+        "serialize_$inputTypeId$(request).toString('latin1');\n");
+      printer.Outdent();
+      printer.Print("return this.cache.fetch(key, call);\n");
+    } else {
+      printer.Print("return call();\n");
+    }
+
+    printer.Outdent();
+    printer.Print("}\n");
+  }
+
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceCallPolicy
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::vector<std::pair<const MethodDescriptor*, grpc_node::MethodPolicy>>
+    entries;
+  bool hasSizeLimit = false;
+
+  for(auto i=0; service->method_count() > i; ++i) {
+    auto method = service->method(i);
+    grpc_node::MethodPolicy policy;
+    if(!GetServiceConfigPolicy(method, &policy, error)) {
+      return false;
+    }
+    if(HasCallPolicyEntry(policy)) {
+      entries.emplace_back(method, policy);
+      hasSizeLimit = hasSizeLimit ||
+        policy.has_max_request_message_bytes() ||
+        policy.has_max_response_message_bytes();
+    }
+  }
+
+  if(entries.empty()) {
+    return true;
+  }
+
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+
+  printer.Print(vars, "export const $ServiceName$CallPolicy = {\n");
+  printer.Indent();
+  for(const auto& entry : entries) {
+    const auto& policy = entry.second;
+    vars["methodName"] = GetMethodInterfaceName(entry.first);
+
+    printer.Print(vars, "$methodName$: {\n");
+    printer.Indent();
+    if(policy.has_compression()) {
+      printer.Print("compression: '$compression$',\n",
+        "compression", CompressionName(policy.compression()));
+      printer.Print("compressionThreshold: $threshold$,\n",
+        "threshold", std::to_string(policy.compression_threshold_bytes()));
+    }
+    if(policy.has_max_request_message_bytes()) {
+      printer.Print("maxRequestMessageBytes: $bytes$,\n",
+        "bytes", std::to_string(policy.max_request_message_bytes()));
+    }
+    if(policy.has_max_response_message_bytes()) {
+      printer.Print("maxResponseMessageBytes: $bytes$,\n",
+        "bytes", std::to_string(policy.max_response_message_bytes()));
+    }
+    printer.Outdent();
+    printer.Print("},\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  if(!hasSizeLimit) {
+    return true;
+  }
+
+  // A server only has channel-wide limits, so it has to admit the largest
+  // message any method allows. Tighter method limits are left to
+  // limit<Service>Implementation.
+  auto limits = GetServerMessageSizeLimits(service);
+  printer.Print(vars, "export const $ServiceName$ServerOptions = {\n");
+  printer.Indent();
+  printer.Print("'grpc.max_receive_message_length': $bytes$,\n",
+    "bytes", std::to_string(limits.receive));
+  printer.Print("'grpc.max_send_message_length': $bytes$,\n",
+    "bytes", std::to_string(limits.send));
+  printer.Outdent();
+  printer.Print("};\n\n");
+
+  return PrintServiceSizeLimits(printer, options, service, error);
+}
+
+bool GrpcNodeGenerator::PrintServiceSizeLimits
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  if(!HasHandlerSizeLimit(service)) {
+    return true;
+  }
+
+  auto limits = GetServerMessageSizeLimits(service);
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()}
+  };
+  auto methodCount = service->method_count();
+
+  printer.Print(vars, "export function limit$ServiceName$Implementation\n");
+  printer.Indent();
+  printer.Print(vars,
+    "( implementation: I$ServiceName$Implementation\n"
+    "): I$ServiceName$Implementation {\n"
+    "return {\n");
+  printer.Indent();
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto policy = utils::getMethodPolicy(method);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+
+    if(!HasHandlerSizeLimit(method, limits)) {
+      printer.Print(vars, "$methodName$: implementation$methodAccessor$,\n");
+      continue;
+    }
+
+    vars["inputTypeId"] =
+      utils::messageIdentifierName(method->input_type()->full_name());
+    vars["outputTypeId"] =
+      utils::messageIdentifierName(method->output_type()->full_name());
+    vars["requestLimit"] =
+      std::to_string(policy.max_request_message_bytes());
+    vars["responseLimit"] =
+      std::to_string(policy.max_response_message_bytes());
+
+    if(method->server_streaming()) {
+      printer.Print(vars, "$methodName$: (call: any) => {\n");
+    } else {
+      printer.Print(vars, "$methodName$: (call: any, callback: any) => {\n");
+    }
+    printer.Indent();
+
+    if(HasHandlerRequestLimit(method, limits)) {
+      if(method->client_streaming()) {
+        printer.Print(vars,
+          "grpcNodeLimitReads(call,\n"
+          "  grpcNodeReceivedSize(serialize_$inputTypeId$), $requestLimit$);\n");
+      } else {
+        printer.Print(vars,
+          "const received = grpcNodeCheckSize('Received message',\n"
+          "  call.request, grpcNodeReceivedSize(serialize_$inputTypeId$),\n"
+          "  $requestLimit$);\n"
+          "if (received) {\n");
+        if(method->server_streaming()) {
+          printer.Print("  call.emit('error', received);\n");
+        } else {
+          printer.Print("  callback(received);\n");
+        }
+        printer.Print(
+          "  return;\n"
+          "}\n");
+      }
+    }
+
+    bool limitsResponse = HasHandlerResponseLimit(method, limits);
+    if(limitsResponse && method->server_streaming()) {
+      printer.Print(vars,
+        "grpcNodeLimitWrites(call,\n"
+        "  grpcNodeResponseSize(serialize_$outputTypeId$), $responseLimit$);\n");
+    }
+
+    if(method->server_streaming()) {
+      printer.Print(vars, "implementation$methodAccessor$(call);\n");
+    } else
+    if(limitsResponse) {
+      printer.Print(vars,
+        "implementation$methodAccessor$(call, grpcNodeLimitCallback(callback,\n"
+        "  grpcNodeResponseSize(serialize_$outputTypeId$), $responseLimit$));\n");
+    } else {
+      printer.Print(vars, "implementation$methodAccessor$(call, callback);\n");
+    }
+
+    printer.Outdent();
+    printer.Print("},\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintServiceClientClass
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&          options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  ) const
+{
+  std::map<std::string, std::string> vars = {
+    {"ServiceName", service->name()},
+    {"ServiceFullName", service->full_name()}
+  };
+
+  printer.Print(vars,
+    "export interface I$ServiceName$Client extends grpc.Client {\n");
+  printer.Indent();
+
+  auto methodCount = service->method_count();
+
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    auto inputType = method->input_type();
+    auto outputType = method->output_type();
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["RequestType"] = options.messageBackend().TypePath(inputType);
+    vars["ResponseType"] = options.messageBackend().TypePath(outputType);
+    
+    PrintClientMethodOverloads(printer, vars, method);
+  }
+
+  printer.Outdent();
+  printer.Print(vars, "}\n\n");
+
+  printer.Print(vars, "export interface $ServiceName$ClientConstructor {\n");
+  printer.Indent();
+  printer.Print(vars, "new ("
+    "address: string, "
+    "credentials: grpc.ChannelCredentials, "
+    "options?: object"
+    "): I$ServiceName$Client;\n");
+  printer.Outdent();
+  printer.Print("}\n\n");
+
+  // Marked pure so a bundler can drop the client of an unused service module.
+  vars["PureAnnotation"] = options.splitServices() ? "/*#__PURE__*/ " : "";
+
+  bool hasServiceConfig = HasServiceConfig(service);
+  bool hasCompression = HasCompressionPolicy(service);
+
+  if(!hasServiceConfig && !hasCompression) {
+    printer.Print(vars,
+      "export const $ServiceName$Client = <$ServiceName$ClientConstructor>\n");
+    printer.Indent();
+    printer.Print(vars,
+      "$PureAnnotation$grpc.makeGenericClientConstructor("
+        "$ServiceName$Service, '$ServiceFullName$', {});\n\n");
+    printer.Outdent();
+    return true;
+  }
+
+  // Channel options given by the caller still override the generated
+  // service config.
+  printer.Print(vars,
+    "const $ServiceName$ClientBase =\n");
+  printer.Indent();
+  printer.Print(vars,
+    "$PureAnnotation$grpc.makeGenericClientConstructor("
+      "$ServiceName$Service, '$ServiceFullName$', {});\n\n");
+  printer.Outdent();
+
+  printer.Print(vars,
+    "export const $ServiceName$Client = <$ServiceName$ClientConstructor><any>\n");
+  printer.Indent();
+  printer.Print(vars,
+    "class extends $ServiceName$ClientBase {\n");
+  printer.Indent();
+  if(hasServiceConfig) {
+    printer.Print(vars,
+      "constructor"
+      "(address: string, credentials: grpc.ChannelCredentials, options?: object) {\n");
+    printer.Indent();
+    printer.Print(vars, "super(address, credentials, {\n");
+    printer.Indent();
+    printer.Print(vars,
+      "'grpc.service_config': JSON.stringify($ServiceName$ServiceConfig),\n");
+    printer.Print(vars, "'grpc.enable_retries': 1,\n");
+    printer.Print(vars, "...options,\n");
+    printer.Outdent();
+    printer.Print("});\n");
+    printer.Outdent();
+    printer.Print("}\n");
+  }
+
+  // Methods with a compression policy request it per call.
+  for(auto i=0; methodCount > i; ++i) {
+    auto method = service->method(i);
+    if(!utils::getMethodPolicy(method).has_compression()) {
+      continue;
+    }
+
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["methodAccessor"] = GetMethodAccessor(method);
+    vars["request"] = method->client_streaming() ? "undefined" : "request";
+    vars["requestParameter"] =
+      method->client_streaming() ? "" : "request: any, ";
+
+    printer.Print("\n");
+    printer.Print(vars,
+      "$methodName$($requestParameter$...args: any[]): any {\n"
+      "  return grpcNodeCompressedCall(this, $ServiceName$Service$methodAccessor$,\n"
+      "    $ServiceName$CallPolicy$methodAccessor$, $request$, args);\n"
+      "}\n");
+  }
+  printer.Outdent();
+  printer.Print("};\n\n");
+  printer.Outdent();
+
+  return true;
+}
+
+bool GrpcNodeGenerator::GenerateImports
+  ( google::protobuf::io::Printer&           printer
+  , const GrpcNodeGeneratorOptions&          options
+  , const google::protobuf::FileDescriptor*  file
+  , std::string*                             error
+  , GrpcNodeModuleStats*                     stats
+  ) const
+{
+  PrintGrpcImport(printer, options, stats);
+  PrintNodeImports(printer, options, stats);
+
+  for(auto imported : GetImportedProtoFiles(file)) {
+    PrintMessageModuleImport(printer, options, file->name(), imported->name());
+    if(stats != nullptr) {
+      ++stats->imports;
+      CollectPbModules(imported, &stats->pbModules);
+    }
+  }
+
+  printer.Print("\n");
+
+  // auto serviceCount = file->service_count();
+
+  // std::map<std::string, std::set<const Descriptor*>> descriptors;
+
+  // for(auto i=0; serviceCount > i; ++i) {
+  //   auto service = file->service(i);
+  //   auto methodCount = service->method_count();
+
+  //   for(auto i=0; methodCount > i; ++i) {
+  //     auto method = service->method(i);
+  //     auto inputType = method->input_type();
+  //     auto outputType = method->output_type();
+
+  //     auto inputPath = utils::removePathExtname(inputType->file()->name());
+  //     auto outputPath = utils::removePathExtname(outputType->file()->name());
+
+  //     if(descriptors.find(inputPath) == descriptors.end()) {
+  //       descriptors.insert({inputPath, {}});
+  //     }
+
+  //     if(descriptors.find(outputPath) == descriptors.end()) {
+  //       descriptors.insert({outputPath, {}});
+  //     }
+
+  //     descriptors.find(inputPath)->second.insert(inputType);
+  //     descriptors.find(outputPath)->second.insert(outputType);
+  //   }
+  // }
+
+  // for(auto pair : descriptors) {
+  //   auto path = pair.first;
+  //   auto lastSlashIndex = path.find_last_of('/');
+    
+  //   if(lastSlashIndex != std::string::npos) {
+  //     path = path.substr(lastSlashIndex + 1);
+  //   }
+
+  //   vars["ImportPath"] = "./" + path + "_pb";
+
+  //   printer.Print(vars, "import {\n");
+  //   printer.Indent();
+
+  //   for(auto descriptor : pair.second) {
+  //     vars["ImportName"] = descriptor->name();
+  //     printer.Print(vars, "$ImportName$,\n");
+  //   }
+
+  //   printer.Outdent();
+  //   printer.Print(vars, "} from '$ImportPath$';\n\n");
+  // }
+
+  return true;
+}
+
+bool GrpcNodeGenerator::PrintRuntimeHelpers
+  ( google::protobuf::io::Printer&                                  printer
+  , const GrpcNodeGeneratorOptions&                                 options
+  , const std::vector<const google::protobuf::ServiceDescriptor*>&  services
+  , std::string*                                                    error
+  ) const
+{
+  bool needsResponseCache = false;
+  bool needsServiceConfig = false;
+  for(auto service : services) {
+    needsResponseCache = needsResponseCache ||
+      (options.cachingClient() && HasCacheableMethod(service));
+    needsServiceConfig = needsServiceConfig || HasServiceConfig(service);
+  }
+
+  // The subset of the gRPC service config the generator emits. Not exported:
+  // with split_services every service module has its own copy.
+  if(needsServiceConfig) {
+    printer.Print(
+      "// See https://github.com/grpc/grpc/blob/master/doc/service_config.md\n"
+      "interface GrpcNodeServiceConfig {\n"
+      "  methodConfig: GrpcNodeMethodConfig[];\n"
+      "}\n\n"
+      "interface GrpcNodeMethodConfig {\n"
+      "  name: { service: string, method?: string }[];\n"
+      "  timeout?: string;\n"
+      "  waitForReady?: boolean;\n"
+      "  maxRequestMessageBytes?: number;\n"
+      "  maxResponseMessageBytes?: number;\n"
+      "  retryPolicy?: GrpcNodeRetryPolicy;\n"
+      "  hedgingPolicy?: GrpcNodeHedgingPolicy;\n"
+      "}\n\n"
+      "interface GrpcNodeRetryPolicy {\n"
+      "  maxAttempts: number;\n"
+      "  initialBackoff: string;\n"
+      "  maxBackoff: string;\n"
+      "  backoffMultiplier: number;\n"
+      "  retryableStatusCodes: string[];\n"
+      "}\n\n"
+      "interface GrpcNodeHedgingPolicy {\n"
+      "  maxAttempts: number;\n"
+      "  hedgingDelay?: string;\n"
+      "  nonFatalStatusCodes?: string[];\n"
+      "}\n\n");
+  }
+
+  if(needsResponseCache) {
+    printer.Print(
+      "// Returns the cache key of a caller, or undefined to skip the cache.\n"
+      "type GrpcNodeCacheKeyFor =\n"
+      "  ( metadata: grpc.Metadata | null | undefined\n"
+      "  , options: grpc.CallOptions | null | undefined\n"
+      "  ) => string | undefined;\n\n"
+      "// Single-flight TTL/LRU cache shared by the generated caching clients.\n"
+      "class GrpcNodeResponseCache {\n"
+      "  private entries = new Map<string, { expires: number, value: any }>();\n"
+      "  private inflight = new Map<string, Promise<any>>();\n"
+      "  hits = 0;\n"
+      "  misses = 0;\n"
+      "  deduplicated = 0;\n"
+      "\n"
+      "  constructor(private maxEntries: number, private ttlMs: number) {}\n"
+      "\n"
+      "  get size(): number {\n"
+      "    return this.entries.size;\n"
+      "  }\n"
+      "\n"
+      "  fetch<T>(key: string, load: () => Promise<T>): Promise<T> {\n"
+      "    const entry = this.entries.get(key);\n"
+      "    if (entry !== undefined) {\n"
+      "      this.entries.delete(key);\n"
+      "      if (entry.expires > Date.now()) {\n"
+      "        this.entries.set(key, entry);\n"
+      "        this.hits++;\n"
+      "        return Promise.resolve(entry.value);\n"
+      "      }\n"
+      "    }\n"
+      "\n"
+      "    const pending = this.inflight.get(key);\n"
+      "    if (pending !== undefined) {\n"
+      "      this.deduplicated++;\n"
+      "      return pending;\n"
+      "    }\n"
+      "\n"
+      "    this.misses++;\n"
+      "    const promise = load().then(value => {\n"
+      "      this.inflight.delete(key);\n"
+      "      if (this.maxEntries > 0 && this.ttlMs > 0) {\n"
+      "        this.entries.set(key, { expires: Date.now() + this.ttlMs, value });\n"
+      "        if (this.entries.size > this.maxEntries) {\n"
+      "          this.entries.delete(<string>this.entries.keys().next().value);\n"
+      "        }\n"
+      "      }\n"
+      "      return value;\n"
+      "    }, err => {\n"
+      "      this.inflight.delete(key);\n"
+      "      throw err;\n"
+      "    });\n"
+      "    this.inflight.set(key, promise);\n"
+      "    return promise;\n"
+      "  }\n"
+      "}\n\n");
+  }
+
+  if(options.passthrough() && !services.empty()) {
+    printer.Print(
+      "// Serializer of passthrough definitions: messages stay raw bytes.\n"
+      "function grpcNodeIdentity(buffer: Buffer): Buffer {\n"
+      "  return buffer;\n"
+      "}\n\n");
+  }
+
+  std::map<std::string, const Descriptor*> chunkedTypes;
+  for(auto service : services) {
+    for(auto i=0; service->method_count() > i; ++i) {
+      auto method = service->method(i);
+      if(IsChunked(method)) {
+        chunkedTypes[method->input_type()->full_name()] = method->input_type();
+        chunkedTypes[method->output_type()->full_name()] =
+          method->output_type();
+      }
+    }
+  }
+
+  if(!chunkedTypes.empty()) {
+    printer.Print(
+      "// Writes `chunks` to `stream` while it accepts writes and calls `end`\n"
+      "// after the last one, so only a few chunks are buffered at a time.\n"
+      "function grpcNodeWriteChunks\n"
+      "  ( stream: any\n"
+      "  , chunks: Iterator<any>\n"
+      "  , end: () => void\n"
+      "  ): void {\n"
+      "  let stopped = false;\n"
+      "  stream.on('error', () => stopped = true);\n"
+      "  stream.on('cancelled', () => stopped = true);\n"
+      "  const pump = () => {\n"
+      "    while (!stopped) {\n"
+      "      const next = chunks.next();\n"
+      "      if (next.done) {\n"
+      "        end();\n"
+      "        return;\n"
+      "      }\n"
+      "      if (!stream.write(next.value)) {\n"
+      "        stream.once('drain', pump);\n"
+      "        return;\n"
+      "      }\n"
+      "    }\n"
+      "  };\n"
+      "  pump();\n"
+      "}\n\n"
+      "// Client side of a chunked call: sends the request chunks and resolves\n"
+      "// with the response assembled from the chunks received.\n"
+      "function grpcNodeChunkedCall<T>\n"
+      "  ( call: any\n"
+      "  , chunks: Iterator<any>\n"
+      "  , assembler: { push(chunk: any): void, finish(): T }\n"
+      "  ): Promise<T> {\n"
+      "  return new Promise<T>((resolve, reject) => {\n"
+      "    let ended = false;\n"
+      "    let succeeded = false;\n"
+      "    const settle = () => {\n"
+      "      if (ended && succeeded) {\n"
+      "        resolve(assembler.finish());\n"
+      "      }\n"
+      "    };\n"
+      "    call.on('data', (chunk: any) => assembler.push(chunk));\n"
+      "    call.on('error', reject);\n"
+      "    call.on('end', () => {\n"
+      "      ended = true;\n"
+      "      settle();\n"
+      "    });\n"
+      "    call.on('status', (status: { code: number }) => {\n"
+      "      succeeded = status.code === grpc.status.OK;\n"
+      "      settle();\n"
+      "    });\n"
+      "    grpcNodeWriteChunks(call, chunks, () => call.end());\n"
+      "  });\n"
+      "}\n\n"
+      "// Server side of a chunked call: runs the unary `handler` with the\n"
+      "// assembled request and sends its response back in chunks.\n"
+      "function grpcNodeServeChunked<Req, Res>\n"
+      "  ( call: any\n"
+      "  , assembler: { push(chunk: Req): void, finish(): Req }\n"
+      "  , handler: (call: any, callback: any) => void\n"
+      "  , chunk: (response: Res) => Iterator<Res>\n"
+      "  ): void {\n"
+      "  call.on('data', (request: Req) => assembler.push(request));\n"
+      "  call.on('end', () => {\n"
+      "    // The handler sees the stream as a unary call of the request.\n"
+      "    const unaryCall = Object.create(call, {\n"
+      "      request: { value: assembler.finish() },\n"
+      "    });\n"
+      "    handler(unaryCall, (error: any, response: Res, trailer?: grpc.Metadata) => {\n"
+      "      if (error) {\n"
+      "        call.emit('error', error);\n"
+      "        return;\n"
+      "      }\n"
+      "      grpcNodeWriteChunks(call, chunk(response), () => call.end(trailer));\n"
+      "    });\n"
+      "  });\n"
+      "}\n\n");
+
+    for(const auto& it : chunkedTypes) {
+      PrintMessageChunker(printer, options, it.second);
+    }
+  }
+
+  if(options.admissionControl() && !services.empty()) {
+    printer.Print(
+      "// In-flight limits and wait queues of the methods of one service.\n"
+      "// Once the queues together hold maxQueuedTotal calls, a call may only\n"
+      "// queue by shedding the newest queued call of a lower priority.\n"
+      "class GrpcNodeAdmission {\n"
+      "  private methods = new Map<string, {\n"
+      "    limit: number,\n"
+      "    queueLimit: number,\n"
+      "    priority: number,\n"
+      "    inFlight: number,\n"
+      "    queue: Array<{ run: () => void, shed: () => void }>,\n"
+      "  }>();\n"
+      "  private queued = 0;\n"
+      "  private readonly maxQueuedTotal: number;\n"
+      "\n"
+      "  constructor\n"
+      "    ( policy: { [method: string]: { maxConcurrent: number, maxQueued: number, priority: number } }\n"
+      "    , private readonly config: {\n"
+      "        methods?: { [method: string]: { maxConcurrent?: number, maxQueued?: number } | undefined },\n"
+      "        maxQueuedTotal?: number,\n"
+      "        onShed?: (method: string) => void,\n"
+      "      }\n"
+      "    ) {\n"
+      "    const overrides = config.methods || {};\n"
+      "    for (const method of Object.keys(policy)) {\n"
+      "      const override = overrides[method] || {};\n"
+      "      this.methods.set(method, {\n"
+      "        limit: override.maxConcurrent !== undefined ?\n"
+      "          override.maxConcurrent : policy[method].maxConcurrent,\n"
+      "        queueLimit: override.maxQueued !== undefined ?\n"
+      "          override.maxQueued : policy[method].maxQueued,\n"
+      "        priority: policy[method].priority,\n"
+      "        inFlight: 0,\n"
+      "        queue: [],\n"
+      "      });\n"
+      "    }\n"
+      "    this.maxQueuedTotal = config.maxQueuedTotal !== undefined ?\n"
+      "      config.maxQueuedTotal : Infinity;\n"
+      "  }\n"
+      "\n"
+      "  // Calls `start` with the function ending the call's admission once\n"
+      "  // `method` has a free slot, or `shed` with a RESOURCE_EXHAUSTED error.\n"
+      "  // The slot is held until the handler finishes or the call is\n"
+      "  // cancelled, so a handler that never ends a cancelled stream does not\n"
+      "  // keep it.\n"
+      "  admit\n"
+      "    ( method: string\n"
+      "    , call: any\n"
+      "    , start: (release: () => void) => void\n"
+      "    , shed: (error: any) => void\n"
+      "    ): void {\n"
+      "    const state = this.methods.get(method)!;\n"
+      "    const run = () => {\n"
+      "      let released = false;\n"
+      "      const release = () => {\n"
+      "        if (released) {\n"
+      "          return;\n"
+      "        }\n"
+      "        released = true;\n"
+      "        state.inFlight--;\n"
+      "        const next = state.queue.shift();\n"
+      "        if (next !== undefined) {\n"
+      "          this.queued--;\n"
+      "          next.run();\n"
+      "        }\n"
+      "      };\n"
+      "      state.inFlight++;\n"
+      "      call.on('cancelled', release);\n"
+      "      start(release);\n"
+      "    };\n"
+      "    const reject = () => {\n"
+      "      if (this.config.onShed) {\n"
+      "        this.config.onShed(method);\n"
+      "      }\n"
+      "      const details = method + ': too many concurrent calls';\n"
+      "      shed(Object.assign(new Error(details), {\n"
+      "        code: grpc.status.RESOURCE_EXHAUSTED,\n"
+      "        details,\n"
+      "        metadata: new grpc.Metadata(),\n"
+      "      }));\n"
+      "    };\n"
+      "\n"
+      "    if (state.inFlight < state.limit) {\n"
+      "      run();\n"
+      "      return;\n"
+      "    }\n"
+      "    if (state.queue.length >= state.queueLimit ||\n"
+      "        !this.makeRoom(state.priority)) {\n"
+      "      reject();\n"
+      "      return;\n"
+      "    }\n"
+      "\n"
+      "    const entry = { run, shed: reject };\n"
+      "    state.queue.push(entry);\n"
+      "    this.queued++;\n"
+      "    call.on('cancelled', () => {\n"
+      "      const index = state.queue.indexOf(entry);\n"
+      "      if (index >= 0) {\n"
+      "        state.queue.splice(index, 1);\n"
+      "        this.queued--;\n"
+      "      }\n"
+      "    });\n"
+      "  }\n"
+      "\n"
+      "  private makeRoom(priority: number): boolean {\n"
+      "    if (this.queued < this.maxQueuedTotal) {\n"
+      "      return true;\n"
+      "    }\n"
+      "    let victim: { priority: number, queue: Array<{ shed: () => void }> } | undefined;\n"
+      "    for (const state of this.methods.values()) {\n"
+      "      if (state.priority < priority && state.queue.length > 0 &&\n"
+      "          (victim === undefined || state.priority < victim.priority)) {\n"
+      "        victim = state;\n"
+      "      }\n"
+      "    }\n"
+      "    if (victim === undefined) {\n"
+      "      return false;\n"
+      "    }\n"
+      "    this.queued--;\n"
+      "    victim.queue.pop()!.shed();\n"
+      "    return true;\n"
+      "  }\n"
+      "}\n\n");
+  }
+
+  if(options.deadlinePropagation() && !services.empty()) {
+    printer.Print(
+      "const GRPC_NODE_DEADLINE_MARGIN_MS = $margin$;\n\n",
+      "margin", std::to_string(options.deadlineMarginMs()));
+
+    printer.Print(
+      "// Deadline and cancellation of an inbound call, for the downstream\n"
+      "// calls its handler makes. Without a call it only carries `deadline`.\n"
+      "class GrpcNodeCallContext {\n"
+      "  readonly deadline: Date | undefined;\n"
+      "  private cancelled = false;\n"
+      "  private listeners: Array<() => void> = [];\n"
+      "\n"
+      "  constructor\n"
+      "    ( call?: any\n"
+      "    , deadline?: Date | number\n"
+      "    , private readonly marginMs: number = GRPC_NODE_DEADLINE_MARGIN_MS\n"
+      "    ) {\n"
+      "    if (deadline === undefined && call && call.getDeadline) {\n"
+      "      deadline = call.getDeadline();\n"
+      "    }\n"
+      "    const ms = deadline instanceof Date ? deadline.getTime() : deadline;\n"
+      "    this.deadline = ms !== undefined && isFinite(ms) ? new Date(ms) : undefined;\n"
+      "    if (call) {\n"
+      "      call.on('cancelled', () => this.cancel());\n"
+      "      if (call.cancelled) {\n"
+      "        this.cancel();\n"
+      "      }\n"
+      "    }\n"
+      "  }\n"
+      "\n"
+      "  get isCancelled(): boolean {\n"
+      "    return this.cancelled;\n"
+      "  }\n"
+      "\n"
+      "  remainingMs(): number {\n"
+      "    return this.deadline === undefined ? Infinity :\n"
+      "      Math.max(0, this.deadline.getTime() - Date.now());\n"
+      "  }\n"
+      "\n"
+      "  onCancel(listener: () => void): void {\n"
+      "    if (this.cancelled) {\n"
+      "      listener();\n"
+      "    } else {\n"
+      "      this.listeners.push(listener);\n"
+      "    }\n"
+      "  }\n"
+      "\n"
+      "  cancel(): void {\n"
+      "    if (this.cancelled) {\n"
+      "      return;\n"
+      "    }\n"
+      "    this.cancelled = true;\n"
+      "    const listeners = this.listeners;\n"
+      "    this.listeners = [];\n"
+      "    listeners.forEach(listener => listener());\n"
+      "  }\n"
+      "\n"
+      "  // `options` with the earlier of its own deadline and this one less\n"
+      "  // the margin.\n"
+      "  callOptions(options: grpc.CallOptions = {}): grpc.CallOptions {\n"
+      "    if (this.deadline === undefined) {\n"
+      "      return options;\n"
+      "    }\n"
+      "    const derived = this.deadline.getTime() - this.marginMs;\n"
+      "    const own = options.deadline instanceof Date ?\n"
+      "      options.deadline.getTime() : options.deadline;\n"
+      "    return {\n"
+      "      ...options,\n"
+      "      deadline: new Date(own !== undefined && own < derived ? own : derived),\n"
+      "    };\n"
+      "  }\n"
+      "}\n\n"
+      "// Starts a downstream call under `context` and cancels it along with\n"
+      "// the inbound call.\n"
+      "function grpcNodeCallWithContext<T extends { cancel(): void }>\n"
+      "  ( context: { callOptions(options: grpc.CallOptions): grpc.CallOptions;\n"
+      "      onCancel(listener: () => void): void } | null\n"
+      "  , options: grpc.CallOptions | null | undefined\n"
+      "  , start: (options: grpc.CallOptions) => T\n"
+      "  ): T {\n"
+      "  if (!context) {\n"
+      "    return start(options || {});\n"
+      "  }\n"
+      "  const call = start(context.callOptions(options || {}));\n"
+      "  context.onCancel(() => call.cancel());\n"
+      "  return call;\n"
+      "}\n\n");
+  }
+
+  bool needsCompressedCall = false;
+  for(auto service : services) {
+    needsCompressedCall = needsCompressedCall || HasCompressionPolicy(service);
+  }
+
+  if(needsCompressedCall) {
+    printer.Print(
+      "// Starts a call with the compression its CallPolicy asks for. Single\n"
+      "// requests are serialized up front so the threshold can be checked,\n"
+      "// and the bytes are reused for the call itself.\n"
+      "function grpcNodeCompressedCall\n"
+      "  ( client: any\n"
+      "  , method: grpc.MethodDefinition<any, any>\n"
+      "  , policy: { compression: string, compressionThreshold: number }\n"
+      "  , request: any\n"
+      "  , args: any[]\n"
+      "  ): any {\n"
+      "  let metadata: grpc.Metadata | undefined;\n"
+      "  let options: grpc.CallOptions = {};\n"
+      "  let callback: Function | undefined;\n"
+      "  for (const arg of args) {\n"
+      "    if (arg instanceof grpc.Metadata) {\n"
+      "      metadata = arg;\n"
+      "    } else if (typeof arg === 'function') {\n"
+      "      callback = arg;\n"
+      "    } else if (arg) {\n"
+      "      options = arg;\n"
+      "    }\n"
+      "  }\n"
+      "  metadata = metadata ? metadata.clone() : new grpc.Metadata();\n"
+      "\n"
+      "  if (method.requestStream) {\n"
+      "    metadata.set('grpc-internal-encoding-request', policy.compression);\n"
+      "    return method.responseStream ?\n"
+      "      client.makeBidiStreamRequest(method.path, method.requestSerialize,\n"
+      "        method.responseDeserialize, metadata, options) :\n"
+      "      client.makeClientStreamRequest(method.path, method.requestSerialize,\n"
+      "        method.responseDeserialize, metadata, options, callback);\n"
+      "  }\n"
+      "\n"
+      "  const bytes = method.requestSerialize(request);\n"
+      "  if (bytes.length >= policy.compressionThreshold) {\n"
+      "    metadata.set('grpc-internal-encoding-request', policy.compression);\n"
+      "  }\n"
+      "  const serialize = () => bytes;\n"
+      "  return method.responseStream ?\n"
+      "    client.makeServerStreamRequest(method.path, serialize,\n"
+      "      method.responseDeserialize, request, metadata, options) :\n"
+      "    client.makeUnaryRequest(method.path, serialize,\n"
+      "      method.responseDeserialize, request, metadata, options, callback);\n"
+      "}\n\n");
+  }
+
+  bool needsSizeLimits = false;
+  for(auto service : services) {
+    needsSizeLimits = needsSizeLimits || HasHandlerSizeLimit(service);
+  }
+
+  if(needsSizeLimits) {
+    printer.Print(
+      "// Sizes of received messages, recorded as they are decoded, and the\n"
+      "// encodings of responses measured before they are sent, so checking a\n"
+      "// size limit does not encode a message twice.\n"
+      "const grpcNodeReceivedSizes = new WeakMap<object, number>();\n"
+      "const grpcNodeEncodedResponses = new WeakMap<object, Buffer>();\n"
+      "\n"
+      "function grpcNodeMeasureReceived<T>\n"
+      "  ( deserialize: (buffer: Buffer) => T\n"
+      "  ): (buffer: Buffer) => T {\n"
+      "  return (buffer: Buffer) => {\n"
+      "    const message = deserialize(buffer);\n"
+      "    grpcNodeReceivedSizes.set(<any>message, buffer.length);\n"
+      "    return message;\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "function grpcNodeReuseEncoded<T>\n"
+      "  ( serialize: (message: T) => Buffer\n"
+      "  ): (message: T) => Buffer {\n"
+      "  return (message: T) => {\n"
+      "    const buffer = grpcNodeEncodedResponses.get(<any>message);\n"
+      "    if (buffer === undefined) {\n"
+      "      return serialize(message);\n"
+      "    }\n"
+      "    grpcNodeEncodedResponses.delete(<any>message);\n"
+      "    return buffer;\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "// Encodes a message again only if it was not received through\n"
+      "// grpcNodeMeasureReceived, e.g. when called in process.\n"
+      "function grpcNodeReceivedSize<T>\n"
+      "  ( serialize: (message: T) => Buffer\n"
+      "  ): (message: T) => number {\n"
+      "  return (message: T) => {\n"
+      "    const size = grpcNodeReceivedSizes.get(<any>message);\n"
+      "    return size !== undefined ? size : serialize(message).length;\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "function grpcNodeResponseSize<T>\n"
+      "  ( serialize: (message: T) => Buffer\n"
+      "  ): (message: T) => number {\n"
+      "  return (message: T) => {\n"
+      "    const buffer = serialize(message);\n"
+      "    grpcNodeEncodedResponses.set(<any>message, buffer);\n"
+      "    return buffer.length;\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "// RESOURCE_EXHAUSTED error for a message over its method's size limit,\n"
+      "// or null. Worded like the errors of gRPC's channel-wide limits.\n"
+      "function grpcNodeCheckSize<T>\n"
+      "  ( what: string\n"
+      "  , message: T\n"
+      "  , size: (message: T) => number\n"
+      "  , limit: number\n"
+      "  ): any {\n"
+      "  const bytes = size(message);\n"
+      "  if (bytes <= limit) {\n"
+      "    return null;\n"
+      "  }\n"
+      "  const details = what + ' larger than max (' + bytes + ' vs. ' + limit + ')';\n"
+      "  return Object.assign(new Error(details), {\n"
+      "    code: grpc.status.RESOURCE_EXHAUSTED,\n"
+      "    details,\n"
+      "    metadata: new grpc.Metadata(),\n"
+      "  });\n"
+      "}\n"
+      "\n"
+      "// Fails `call` at the first streamed request over `limit`, which ends the\n"
+      "// requests the handler reads instead of being passed on.\n"
+      "function grpcNodeLimitReads<T>\n"
+      "  ( call: any\n"
+      "  , size: (message: T) => number\n"
+      "  , limit: number\n"
+      "  ): void {\n"
+      "  const push = call.push;\n"
+      "  let failed = false;\n"
+      "  call.push = (message: any, ...rest: any[]) => {\n"
+      "    if (failed) {\n"
+      "      return false;\n"
+      "    }\n"
+      "    const error = message === null ? null :\n"
+      "      grpcNodeCheckSize('Received message', message, size, limit);\n"
+      "    if (error) {\n"
+      "      failed = true;\n"
+      "      call.emit('error', error);\n"
+      "      return push.call(call, null);\n"
+      "    }\n"
+      "    return push.call(call, message, ...rest);\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "// Fails `call` instead of writing a response over `limit`; later writes\n"
+      "// are dropped.\n"
+      "function grpcNodeLimitWrites<T>\n"
+      "  ( call: any\n"
+      "  , size: (message: T) => number\n"
+      "  , limit: number\n"
+      "  ): void {\n"
+      "  const write = call.write;\n"
+      "  let failed = false;\n"
+      "  call.write = (message: T, ...rest: any[]) => {\n"
+      "    if (failed) {\n"
+      "      return false;\n"
+      "    }\n"
+      "    const error = grpcNodeCheckSize('Sent message', message, size, limit);\n"
+      "    if (error) {\n"
+      "      failed = true;\n"
+      "      call.emit('error', error);\n"
+      "      return false;\n"
+      "    }\n"
+      "    return write.call(call, message, ...rest);\n"
+      "  };\n"
+      "}\n"
+      "\n"
+      "// `callback` failing the call instead of sending a response over `limit`.\n"
+      "function grpcNodeLimitCallback<T>\n"
+      "  ( callback: any\n"
+      "  , size: (message: T) => number\n"
+      "  , limit: number\n"
+      "  ): any {\n"
+      "  return (error: any, value?: T, ...rest: any[]) => {\n"
+      "    const oversize = error || !value ? null :\n"
+      "      grpcNodeCheckSize('Sent message', value, size, limit);\n"
+      "    oversize ? callback(oversize) : callback(error, value, ...rest);\n"
+      "  };\n"
+      "}\n\n");
+  }
+
+  bool needsStreamPump = false;
+  bool needsRequestReader = false;
+  for(auto service : services) {
+    needsStreamPump = needsStreamPump ||
+      (options.asyncStreaming() && HasServerStreamingMethod(service, false));
+    needsRequestReader = needsRequestReader ||
+      (options.asyncStreaming() && HasServerStreamingMethod(service, true));
+  }
+
+  if(needsStreamPump) {
+    printer.Print(
+      "const GRPC_NODE_STREAM_WINDOW = $window$;\n\n",
+      "window", std::to_string(options.streamWindow()));
+
+    printer.Print(
+      "// Writes the values produced by `start()` to `call`. The next value is\n"
+      "// only pulled while the stream accepts writes and fewer than\n"
+      "// GRPC_NODE_STREAM_WINDOW writes are unacknowledged. Cancellation\n"
+      "// returns the iterator so generator `finally` blocks run.\n"
+      "function grpcNodePumpStream\n"
+      "  ( call: any\n"
+      "  , start: () => AsyncIterable<any>\n"
+      "  ): void {\n"
+      "  let source: AsyncIterator<any>;\n"
+      "  let inFlight = 0;\n"
+      "  let blocked = false;\n"
+      "  let pulling = false;\n"
+      "  let done = false;\n"
+      "\n"
+      "  const fail = (error: any) => {\n"
+      "    if (done) {\n"
+      "      return;\n"
+      "    }\n"
+      "    done = true;\n"
+      "    call.emit('error', error && error.code !== undefined ? error : {\n"
+      "      code: grpc.status.UNKNOWN,\n"
+      "      details: String(error && error.message || error),\n"
+      "    });\n"
+      "  };\n"
+      "\n"
+      "  const cancel = () => {\n"
+      "    if (done) {\n"
+      "      return;\n"
+      "    }\n"
+      "    done = true;\n"
+      "    if (source.return) {\n"
+      "      source.return().catch(() => undefined);\n"
+      "    }\n"
+      "  };\n"
+      "\n"
+      "  const pull = () => {\n"
+      "    if (done || pulling || blocked || inFlight >= GRPC_NODE_STREAM_WINDOW) {\n"
+      "      return;\n"
+      "    }\n"
+      "    pulling = true;\n"
+      "    source.next().then(result => {\n"
+      "      pulling = false;\n"
+      "      if (done) {\n"
+      "        return;\n"
+      "      }\n"
+      "      if (result.done) {\n"
+      "        done = true;\n"
+      "        call.end();\n"
+      "        return;\n"
+      "      }\n"
+      "      inFlight++;\n"
+      "      blocked = !call.write(result.value, () => {\n"
+      "        inFlight--;\n"
+      "        pull();\n"
+      "      });\n"
+      "      pull();\n"
+      "    }, fail);\n"
+      "  };\n"
+      "\n"
+      "  try {\n"
+      "    source = start()[Symbol.asyncIterator]();\n"
+      "  } catch (error) {\n"
+      "    fail(error);\n"
+      "    return;\n"
+      "  }\n"
+      "  call.on('drain', () => {\n"
+      "    blocked = false;\n"
+      "    pull();\n"
+      "  });\n"
+      "  call.on('cancelled', cancel);\n"
+      "  pull();\n"
+      "}\n\n");
+  }
+
+  if(needsRequestReader) {
+    printer.Print(
+      "// Reads a duplex call's requests in paused mode, so the client is only\n"
+      "// asked for more as the handler consumes them. Leaving the loop early\n"
+      "// does not destroy the call, unlike the stream's own iterator.\n"
+      "async function* grpcNodeReadRequests(call: any): AsyncGenerator<any, void, undefined> {\n"
+      "  let ended = false;\n"
+      "  let failure: any;\n"
+      "  let wake: (() => void) | undefined;\n"
+      "  const signal = () => {\n"
+      "    const resume = wake;\n"
+      "    wake = undefined;\n"
+      "    if (resume) {\n"
+      "      resume();\n"
+      "    }\n"
+      "  };\n"
+      "  const onEnd = () => {\n"
+      "    ended = true;\n"
+      "    signal();\n"
+      "  };\n"
+      "  const onError = (error: any) => {\n"
+      "    failure = error;\n"
+      "    signal();\n"
+      "  };\n"
+      "\n"
+      "  call.on('readable', signal);\n"
+      "  call.on('end', onEnd);\n"
+      "  call.on('error', onError);\n"
+      "  try {\n"
+      "    for (;;) {\n"
+      "      let value: any;\n"
+      "      while ((value = call.read()) !== null) {\n"
+      "        yield value;\n"
+      "      }\n"
+      "      if (failure !== undefined) {\n"
+      "        throw failure;\n"
+      "      }\n"
+      "      if (ended) {\n"
+      "        return;\n"
+      "      }\n"
+      "      await new Promise<void>(resolve => wake = resolve);\n"
+      "    }\n"
+      "  } finally {\n"
+      "    call.removeListener('readable', signal);\n"
+      "    call.removeListener('end', onEnd);\n"
+      "    call.removeListener('error', onError);\n"
+      "  }\n"
+      "}\n\n");
+  }
+
+  std::vector<const Descriptor*> offloaded =
+    GetOffloadedMessages(options, services);
+
+  if(!offloaded.empty()) {
+    printer.Print(
+      "const GRPC_NODE_OFFLOAD_THRESHOLD = $threshold$;\n\n",
+      "threshold", std::to_string(options.offloadThreshold()));
 
-  auto methodCount = service->method_count();
+    printer.Print(
+      "// Decodes offloaded message types on a lazily started worker_threads\n"
+      "// pool. Inputs are transferred to the worker instead of copied. Calls\n"
+      "// pending on a worker that dies are rejected.\n"
+      "class GrpcNodeDeserializePool {\n"
+      "  private workers: { worker: worker_threads.Worker, pending: number }[] = [];\n"
+      "  private calls = new Map<number, {\n"
+      "    resolve: (value: any) => void,\n"
+      "    reject: (error: Error) => void,\n"
+      "    slot: { worker: worker_threads.Worker, pending: number },\n"
+      "  }>();\n"
+      "  private nextId = 0;\n"
+      "\n"
+      "  constructor\n"
+      "    ( private size: number\n"
+      "    , public workerFilename: () => string | URL\n"
+      "    ) {}\n"
+      "\n"
+      "  decode(typeName: string, buffer: Uint8Array): Promise<any> {\n"
+      "    if (this.workers.length < this.size) {\n"
+      "      try {\n"
+      "        this.start();\n"
+      "      } catch (error) {\n"
+      "        return Promise.reject(error);\n"
+      "      }\n"
+      "    }\n"
+      "\n"
+      "    let slot = this.workers[0];\n"
+      "    for (const candidate of this.workers) {\n"
+      "      if (candidate.pending < slot.pending) {\n"
+      "        slot = candidate;\n"
+      "      }\n"
+      "    }\n"
+      "\n"
+      "    // Only a view spanning its whole ArrayBuffer can be transferred.\n"
+      "    const bytes: Uint8Array =\n"
+      "      buffer.byteOffset === 0 && buffer.byteLength === buffer.buffer.byteLength ?\n"
+      "        buffer : Uint8Array.prototype.slice.call(buffer);\n"
+      "    const id = this.nextId++;\n"
+      "    return new Promise<any>((resolve, reject) => {\n"
+      "      this.calls.set(id, { resolve, reject, slot });\n"
+      "      slot.pending++;\n"
+      "      slot.worker.postMessage(\n"
+      "        { id, typeName, bytes }, [<ArrayBuffer>bytes.buffer]);\n"
+      "    });\n"
+      "  }\n"
+      "\n"
+      "  // Starts workers until the pool is full again.\n"
+      "  private start() {\n"
+      "    const filename = this.workerFilename();\n"
+      "    while (this.workers.length < this.size) {\n"
+      "      const slot = {\n"
+      "        worker: new worker_threads.Worker(filename),\n"
+      "        pending: 0,\n"
+      "      };\n"
+      "      slot.worker.unref();\n"
+      "      slot.worker.on('message', (reply: { id: number, value?: any, error?: string }) => {\n"
+      "        const call = this.calls.get(reply.id);\n"
+      "        if (call === undefined) {\n"
+      "          return;\n"
+      "        }\n"
+      "        this.calls.delete(reply.id);\n"
+      "        slot.pending--;\n"
+      "        if (reply.error !== undefined) {\n"
+      "          call.reject(new Error(reply.error));\n"
+      "        } else {\n"
+      "          call.resolve(reply.value);\n"
+      "        }\n"
+      "      });\n"
+      "      slot.worker.on('error', (error: Error) => this.fail(slot, error));\n"
+      "      slot.worker.on('exit', (code: number) => this.fail(slot,\n"
+      "        new Error('Offload worker exited with code ' + code)));\n"
+      "      this.workers.push(slot);\n"
+      "    }\n"
+      "  }\n"
+      "\n"
+      "  private fail\n"
+      "    ( slot: { worker: worker_threads.Worker, pending: number }\n"
+      "    , error: Error\n"
+      "    ) {\n"
+      "    this.workers = this.workers.filter(other => other !== slot);\n"
+      "    this.calls.forEach((call, id) => {\n"
+      "      if (call.slot === slot) {\n"
+      "        this.calls.delete(id);\n"
+      "        call.reject(error);\n"
+      "      }\n"
+      "    });\n"
+      "  }\n"
+      "}\n\n");
 
-  for(auto i=0; methodCount > i; ++i) {
-    auto method = service->method(i);
-    auto inputType = method->input_type();
-    auto outputType = method->output_type();
+    // The worker module only loads message modules, not grpc or services.
+    printer.Print(
+      "// The worker is found next to this module through require, which ES\n"
+      "// modules do not have: they must call set<Service>OffloadWorker first.\n"
+      "const grpcNodeDeserializePool = new GrpcNodeDeserializePool(\n"
+      "  Math.max(1, os.cpus().length - 1),\n"
+      "  () => {\n"
+      "    if (typeof require === 'undefined') {\n"
+      "      throw new Error('Cannot locate the $worker$ offload worker ' +\n"
+      "        'without require; call set<Service>OffloadWorker first');\n"
+      "    }\n"
+      "    return require.resolve('./$worker$');\n"
+      "  });\n\n",
+      "worker", GetBasename(GetOffloadWorkerFilename(services[0]->file())));
+  }
 
-    vars["methodName"] = GetMethodInterfaceName(method);
-    vars["RequestType"] = utils::nodeObjectPath(inputType);
-    vars["ResponseType"] = utils::nodeObjectPath(outputType);
-    
-    if(method->client_streaming() && method->server_streaming()) {
-      printer.Print(vars, "$methodName$: "
-        "grpc.handleBidiStreamingCall<$RequestType$, $ResponseType$>;\n");
-    } else
-    if(method->client_streaming()) {
-      printer.Print(vars, "$methodName$: "
-        "grpc.handleClientStreamingCall<$RequestType$, $ResponseType$>;\n");
-    } else
-    if(method->server_streaming()) {
-      printer.Print(vars, "$methodName$: "
-        "grpc.handleServerStreamingCall<$RequestType$, $ResponseType$>;\n");
-    } else {
-      printer.Print(vars, "$methodName$: "
-        "grpc.handleUnaryCall<$RequestType$, $ResponseType$>;\n");
-    }
+  if(options.pooledClient() && !services.empty()) {
+    printer.Print(
+      "// Builds a client over `poolSize` independent channels. Each call goes\n"
+      "// to the channel with the fewest calls in flight, or round-robin.\n"
+      "function grpcNodePooledClient\n"
+      "  ( Client: any\n"
+      "  , methodNames: string[]\n"
+      "  , address: string\n"
+      "  , credentials: grpc.ChannelCredentials\n"
+      "  , poolSize: number\n"
+      "  , options?: object\n"
+      "  , strategy?: 'least_loaded' | 'round_robin'\n"
+      "  ): any {\n"
+      "  const clients: any[] = [];\n"
+      "  const inflight: number[] = [];\n"
+      "  // Channels with the same target and arguments share subchannels, and\n"
+      "  // so connections, through the global subchannel pool. A local pool\n"
+      "  // per channel gives each its own connection; both targets support\n"
+      "  // grpc.use_local_subchannel_pool (gRPC core since 1.19, which the\n"
+      "  // grpc package bundles, and @grpc/grpc-js).\n"
+      "  for (let i = 0; i < Math.max(1, poolSize); i++) {\n"
+      "    clients.push(new Client(address, credentials, {\n"
+      "      ...options,\n"
+      "      'grpc.use_local_subchannel_pool': 1,\n"
+      "    }));\n"
+      "    inflight.push(0);\n"
+      "  }\n"
+      "\n"
+      "  let next = 0;\n"
+      "  const pick = (): number => {\n"
+      "    let best = next;\n"
+      "    next = (next + 1) % clients.length;\n"
+      "    if (strategy !== 'round_robin') {\n"
+      "      for (let i = 0; i < clients.length; i++) {\n"
+      "        if (inflight[i] < inflight[best]) {\n"
+      "          best = i;\n"
+      "        }\n"
+      "      }\n"
+      "    }\n"
+      "    return best;\n"
+      "  };\n"
+      "\n"
+      "  const pooled: any = {\n"
+      "    close: () => clients.forEach(client => client.close()),\n"
+      "    getChannel: () => clients[0].getChannel(),\n"
+      "    inflight: () => inflight.slice(),\n"
+      "    waitForReady: (deadline: grpc.Deadline, callback: (error: Error | null) => void) => {\n"
+      "      let remaining = clients.length;\n"
+      "      let failed = false;\n"
+      "      clients.forEach(client => client.waitForReady(deadline, (error: Error | null) => {\n"
+      "        if (failed) {\n"
+      "          return;\n"
+      "        }\n"
+      "        if (error) {\n"
+      "          failed = true;\n"
+      "          callback(error);\n"
+      "        } else if (--remaining === 0) {\n"
+      "          callback(null);\n"
+      "        }\n"
+      "      }));\n"
+      "    },\n"
+      "  };\n"
+      "\n"
+      "  const names = methodNames.concat(\n"
+      "    ['makeUnaryRequest', 'makeClientStreamRequest',\n"
+      "     'makeServerStreamRequest', 'makeBidiStreamRequest']);\n"
+      "  for (const name of names) {\n"
+      "    pooled[name] = (...args: any[]) => {\n"
+      "      const index = pick();\n"
+      "      const call = clients[index][name](...args);\n"
+      "      let done = false;\n"
+      "      inflight[index]++;\n"
+      "      call.on('status', () => {\n"
+      "        if (!done) {\n"
+      "          done = true;\n"
+      "          inflight[index]--;\n"
+      "        }\n"
+      "      });\n"
+      "      return call;\n"
+      "    };\n"
+      "  }\n"
+      "\n"
+      "  return pooled;\n"
+      "}\n\n");
   }
 
-  printer.Outdent();
-  printer.Print(vars, "}\n\n");
+  if(options.inProcess() && !services.empty()) {
+    printer.Print(
+      "// Runs one call against `handler` in this process. Messages are passed\n"
+      "// by reference unless copy functions clone them at the boundary.\n"
+      "function grpcNodeInProcessCall\n"
+      "  ( method: grpc.MethodDefinition<any, any>\n"
+      "  , handler: Function\n"
+      "  , request: any\n"
+      "  , metadata: grpc.Metadata\n"
+      "  , callOptions: grpc.CallOptions\n"
+      "  , callback: Function | undefined\n"
+      "  , copyRequest: (value: any) => any\n"
+      "  , copyResponse: (value: any) => any\n"
+      "  ): any {\n"
+      "  const requests = new stream.PassThrough({ objectMode: true });\n"
+      "  const responses = new stream.PassThrough({ objectMode: true });\n"
+      "  let finished = false;\n"
+      "  let trailer: grpc.Metadata | undefined;\n"
+      "  let timer: ReturnType<typeof setTimeout> | undefined;\n"
+      "\n"
+      "  const clientCall: any = new stream.Duplex({\n"
+      "    objectMode: true,\n"
+      "    read: () => { responses.resume(); },\n"
+      "    write: (value: any, encoding: string, done: (error?: Error) => void) => {\n"
+      "      requests.write(copyRequest(value), done);\n"
+      "    },\n"
+      "    final: (done: (error?: Error) => void) => {\n"
+      "      requests.end();\n"
+      "      done();\n"
+      "    },\n"
+      "  });\n"
+      "\n"
+      "  const serverCall: any = new stream.Duplex({\n"
+      "    objectMode: true,\n"
+      "    read: () => { requests.resume(); },\n"
+      "    write: (value: any, encoding: string, done: (error?: Error) => void) => {\n"
+      "      responses.write(copyResponse(value), done);\n"
+      "    },\n"
+      "    final: (done: (error?: Error) => void) => {\n"
+      "      responses.end();\n"
+      "      done();\n"
+      "    },\n"
+      "  });\n"
+      "\n"
+      "  requests.on('data', (value: any) => {\n"
+      "    if (!serverCall.push(value)) {\n"
+      "      requests.pause();\n"
+      "    }\n"
+      "  });\n"
+      "  requests.on('end', () => serverCall.push(null));\n"
+      "  requests.pause();\n"
+      "  responses.on('data', (value: any) => {\n"
+      "    if (!clientCall.push(value)) {\n"
+      "      responses.pause();\n"
+      "    }\n"
+      "  });\n"
+      "  responses.on('end', () => {\n"
+      "    clientCall.push(null);\n"
+      "    finish(null);\n"
+      "  });\n"
+      "  responses.pause();\n"
+      "\n"
+      "  const finish = (error: any, value?: any) => {\n"
+      "    if (finished) {\n"
+      "      return;\n"
+      "    }\n"
+      "    finished = true;\n"
+      "    if (timer !== undefined) {\n"
+      "      clearTimeout(timer);\n"
+      "    }\n"
+      "\n"
+      "    const status = {\n"
+      "      code: error ? (typeof error.code === 'number' ? error.code : grpc.status.UNKNOWN) : grpc.status.OK,\n"
+      "      details: error ? (error.details || error.message) : 'OK',\n"
+      "      metadata: (error && error.metadata) || trailer || new grpc.Metadata(),\n"
+      "    };\n"
+      "\n"
+      "    if (error) {\n"
+      "      const serviceError = Object.assign(\n"
+      "        new Error(status.code + ' ' + status.details), status);\n"
+      "      if (callback) {\n"
+      "        callback(serviceError);\n"
+      "      } else {\n"
+      "        clientCall.emit('error', serviceError);\n"
+      "      }\n"
+      "    } else if (callback) {\n"
+      "      callback(null, copyResponse(value));\n"
+      "    }\n"
+      "    clientCall.emit('status', status);\n"
+      "  };\n"
+      "\n"
+      "  const cancel = (code: number, details: string) => {\n"
+      "    if (finished) {\n"
+      "      return;\n"
+      "    }\n"
+      "    serverCall.cancelled = true;\n"
+      "    serverCall.emit('cancelled');\n"
+      "    finish({ code, details });\n"
+      "  };\n"
+      "\n"
+      "  const deadline = callOptions.deadline instanceof Date ?\n"
+      "    callOptions.deadline.getTime() :\n"
+      "    (callOptions.deadline !== undefined ? Number(callOptions.deadline) : Infinity);\n"
+      "  if (isFinite(deadline)) {\n"
+      "    timer = setTimeout(() => cancel(grpc.status.DEADLINE_EXCEEDED,\n"
+      "      'Deadline exceeded'), Math.max(0, deadline - Date.now()));\n"
+      "  }\n"
+      "\n"
+      "  clientCall.cancel = () => cancel(grpc.status.CANCELLED, 'Cancelled on client');\n"
+      "  clientCall.getPeer = () => 'in-process';\n"
+      "\n"
+      "  serverCall.request = method.requestStream ? undefined : copyRequest(request);\n"
+      "  serverCall.metadata = metadata;\n"
+      "  serverCall.cancelled = false;\n"
+      "  serverCall.getPeer = () => 'in-process';\n"
+      "  serverCall.getDeadline = () => deadline;\n"
+      "  serverCall.sendMetadata = (responseMetadata: grpc.Metadata) => {\n"
+      "    clientCall.emit('metadata', responseMetadata.clone());\n"
+      "  };\n"
+      "  const endServerCall = serverCall.end;\n"
+      "  serverCall.end = (...args: any[]) => {\n"
+      "    if (args[0] instanceof grpc.Metadata) {\n"
+      "      trailer = args.shift();\n"
+      "    }\n"
+      "    return endServerCall.apply(serverCall, args);\n"
+      "  };\n"
+      "  serverCall.on('error', (error: any) => finish(error));\n"
+      "\n"
+      "  setImmediate(() => {\n"
+      "    if (finished) {\n"
+      "      return;\n"
+      "    }\n"
+      "    try {\n"
+      "      if (method.responseStream) {\n"
+      "        handler(serverCall);\n"
+      "      } else {\n"
+      "        handler(serverCall, (error: any, value: any, responseTrailer?: grpc.Metadata) => {\n"
+      "          trailer = responseTrailer;\n"
+      "          finish(error, value);\n"
+      "        });\n"
+      "      }\n"
+      "    } catch (error) {\n"
+      "      finish(error);\n"
+      "    }\n"
+      "  });\n"
+      "\n"
+      "  return clientCall;\n"
+      "}\n"
+      "\n"
+      "// Exposes `implementation` through the generic client surface of\n"
+      "// `definition`, accepting the same optional arguments as grpc clients.\n"
+      "function grpcNodeInProcessClient\n"
+      "  ( definition: grpc.ServiceDefinition<any>\n"
+      "  , implementation: any\n"
+      "  , options: { cloneMessages?: boolean }\n"
+      "  ): any {\n"
+      "  const client: any = {\n"
+      "    close: () => {},\n"
+      "    getChannel: () => {\n"
+      "      throw new Error('In-process clients have no channel');\n"
+      "    },\n"
+      "    waitForReady: (deadline: grpc.Deadline, callback: (error: Error | null) => void) => {\n"
+      "      setImmediate(callback, null);\n"
+      "    },\n"
+      "  };\n"
+      "\n"
+      "  for (const name of Object.keys(definition)) {\n"
+      "    const method = definition[name];\n"
+      "    const handler = typeof implementation[name] === 'function' ?\n"
+      "      implementation[name].bind(implementation) :\n"
+      "      (call: any, callback?: Function) => {\n"
+      "        const error = { code: grpc.status.UNIMPLEMENTED, details: 'Not implemented' };\n"
+      "        callback ? callback(error) : call.emit('error', error);\n"
+      "      };\n"
+      "    const copyRequest = options.cloneMessages ?\n"
+      "      (value: any) => method.requestDeserialize(method.requestSerialize(value)) :\n"
+      "      (value: any) => value;\n"
+      "    const copyResponse = options.cloneMessages ?\n"
+      "      (value: any) => method.responseDeserialize(method.responseSerialize(value)) :\n"
+      "      (value: any) => value;\n"
+      "\n"
+      "    client[name] = (...args: any[]) => {\n"
+      "      const callback = typeof args[args.length - 1] === 'function' ?\n"
+      "        args.pop() : undefined;\n"
+      "      const request = method.requestStream ? undefined : args.shift();\n"
+      "      const metadata = args[0] ? args[0].clone() : new grpc.Metadata();\n"
+      "      return grpcNodeInProcessCall(method, handler, request, metadata,\n"
+      "        args[1] || {}, callback, copyRequest, copyResponse);\n"
+      "    };\n"
+      "  }\n"
+      "\n"
+      "  return client;\n"
+      "}\n\n");
+  }
 
   return true;
 }
 
-bool GrpcNodeGenerator::PrintServiceDefinition
-  ( google::protobuf::io::Printer&              printer
-  , const GrpcNodeGeneratorOptions&          options
-  , const google::protobuf::ServiceDescriptor*  service
-  , std::string*                                error
+bool GrpcNodeGenerator::PrintSyntheticMessageBuilder
+  ( google::protobuf::io::Printer&       printer
+  , const GrpcNodeGeneratorOptions&      options
+  , const google::protobuf::Descriptor*  descriptor
+  , std::string*                         error
   ) const
 {
-  std::map<std::string, std::string> vars = {
-    {"ServiceName", service->name()}
-  };
+  std::map<std::string, std::string> vars;
+  vars["identifierName"] = utils::messageIdentifierName(
+    descriptor->full_name());
+  vars["NodeName"] = options.messageBackend().TypePath(descriptor);
 
   printer.Print(vars,
-    "export const $ServiceName$Service: "
-    "grpc.ServiceDefinition<I$ServiceName$Implementation> = {\n");
+    "function synthesize_$identifierName$"
+    "(options: BenchOptions, depth: number): $NodeName$ {\n");
   printer.Indent();
+  printer.Print(vars, "const message = new $NodeName$();\n");
 
-  auto methodCount = service->method_count();
+  for(auto i=0; descriptor->field_count() > i; ++i) {
+    auto field = descriptor->field(i);
 
-  for(auto i=0; methodCount > i; ++i) {
-    auto method = service->method(i);
-    auto inputType = method->input_type();
-    auto outputType = method->output_type();
+    // Only the first member of a oneof is set; the others would replace it.
+    if(field->containing_oneof() != nullptr && field->index_in_oneof() != 0) {
+      continue;
+    }
 
-    vars["methodName"] = GetMethodInterfaceName(method);
-    vars["RequestType"] = utils::nodeObjectPath(inputType);
-    vars["ResponseType"] = utils::nodeObjectPath(outputType);
-    
-    printer.Print(vars,
-      "$methodName$: <grpc.MethodDefinition<$RequestType$, $ResponseType$>>");
+    bool nested = false;
+    if(field->is_map()) {
+      auto keyField = field->message_type()->FindFieldByName("key");
+      auto valueField = field->message_type()->FindFieldByName("value");
+      nested = valueField->message_type() != nullptr;
+      vars["key"] = SyntheticMapKey(keyField);
+      vars["value"] = SyntheticValue(valueField);
+    } else {
+      nested = field->message_type() != nullptr;
+      vars["value"] = SyntheticValue(field);
+    }
 
-    if(!PrintServiceMethodDefinition(printer, options, method, error)) {
-      return false;
+    // Recursive message types are cut off after a few levels.
+    if(nested) {
+      printer.Print("if (depth < 3) {\n");
+      printer.Indent();
+    }
+
+    const auto& backend = options.messageBackend();
+    if(field->is_map()) {
+      printer.Print(
+        "for (let i = 0; i < options.repeatedCount; i++) {\n"
+        "  $statement$\n"
+        "}\n",
+        "statement", backend.SetMapEntryStatement(
+          field, "message", vars["key"], vars["value"]));
+    } else
+    if(field->is_repeated()) {
+      printer.Print("$statement$\n",
+        "statement", backend.SetRepeatedFieldStatement(field, "message",
+          "Array.from({ length: options.repeatedCount }, () => " +
+          vars["value"] + ")"));
+    } else {
+      printer.Print("$statement$\n",
+        "statement", backend.SetFieldStatement(field, "message", vars["value"]));
     }
 
-    printer.Print(",\n");
+    if(nested) {
+      printer.Outdent();
+      printer.Print("}\n");
+    }
   }
 
+  printer.Print("return message;\n");
   printer.Outdent();
-  printer.Print(vars, "}\n\n");
+  printer.Print("}\n\n");
 
   return true;
 }
 
-bool GrpcNodeGenerator::PrintMessageTransformer
-  ( google::protobuf::io::Printer&       printer
-  , const GrpcNodeGeneratorOptions&      options
-  , const google::protobuf::Descriptor*  descriptor
-  , std::string*                         error
+bool GrpcNodeGenerator::GenerateOffloadWorker
+  ( const google::protobuf::FileDescriptor*        file
+  , const GrpcNodeGeneratorOptions&                options
+  , google::protobuf::compiler::GeneratorContext*  context
+  , std::string*                                   error
   ) const
 {
-  std::map<std::string, std::string> vars;
-  std::string fullName = descriptor->full_name();
-  vars["identifierName"] = utils::messageIdentifierName(fullName);
-  vars["name"] = fullName;
-  vars["NodeName"] = utils::nodeObjectPath(descriptor);
+  std::vector<const ServiceDescriptor*> services;
+  for(auto i=0; file->service_count() > i; ++i) {
+    services.push_back(file->service(i));
+  }
 
-  // Print the serializer
-  printer.Print(vars, "function serialize_$identifierName$(arg: $NodeName$): any {\n");
-  printer.Indent();
-  // printer.Print(vars, "if (!(arg instanceof $NodeName$)) {\n");
-  // printer.Indent();
-  // printer.Print(vars, "throw new Error('Expected argument of type $name$');\n");
-  // printer.Outdent();
-  // printer.Print("}\n");
-  // printer.Print("console.trace(arg);\n");
-  printer.Print("return Buffer.from(arg.serializeBinary());\n");
-  printer.Outdent();
-  printer.Print("}\n\n");
+  auto offloaded = GetOffloadedMessages(options, services);
+  if(offloaded.empty()) {
+    return true;
+  }
 
-  // Print the deserializer
-  printer.Print(vars,
-    "function deserialize_$identifierName$(buffer_arg: any): any {\n");
+  std::unique_ptr<ZeroCopyOutputStream> workerOutput(
+    context->Open(GetOffloadWorkerFilename(file) + ".ts")
+  );
+  Printer printer(workerOutput.get(), '$');
+
+  printer.Print("// GENERATED CODE\n\n");
+  printer.Print(
+    "// Run by the offload pool workers of the $module$ services. Only the\n"
+    "// message modules are loaded here.\n\n",
+    "module", file->name());
+  printer.Print("import * as worker_threads from 'worker_threads';\n");
+
+  std::set<const FileDescriptor*> imported;
+  for(auto descriptor : offloaded) {
+    if(imported.insert(descriptor->file()).second) {
+      PrintMessageModuleImport(
+        printer, options, file->name(), descriptor->file()->name());
+    }
+  }
+  printer.Print("\n");
+
+  for(auto descriptor : offloaded) {
+    printer.Print(
+      "function deserialize_$identifierName$(buffer_arg: Buffer): any {\n",
+      "identifierName", utils::messageIdentifierName(descriptor->full_name()));
+    printer.Indent();
+    options.messageBackend().PrintDeserializerBody(
+      printer, options.messageBackend().TypePath(descriptor));
+    printer.Outdent();
+    printer.Print("}\n\n");
+  }
+
+  // Each entry decodes into the form the backend rebuilds messages from.
+  printer.Print(
+    "const deserializers: "
+    "{ [typeName: string]: (bytes: Uint8Array) => any } = {\n");
   printer.Indent();
-  printer.Print(vars,
-    "return $NodeName$.deserializeBinary(new Uint8Array(buffer_arg));\n");
+  for(auto descriptor : offloaded) {
+    auto identifierName =
+      utils::messageIdentifierName(descriptor->full_name());
+    printer.Print("'$name$': (bytes: Uint8Array) =>\n  $cloneable$,\n",
+      "name", descriptor->full_name(),
+      "cloneable", options.messageBackend().CloneableExpression(
+        options.messageBackend().TypePath(descriptor),
+        "deserialize_" + identifierName + "(<Buffer>bytes)"));
+  }
   printer.Outdent();
-  printer.Print("}\n\n");
+  printer.Print("};\n\n");
+
+  printer.Print(
+    "const port = <worker_threads.MessagePort>worker_threads.parentPort;\n"
+    "port.on('message', (request: { id: number, typeName: string, bytes: Uint8Array }) => {\n"
+    "  try {\n"
+    "    const value = deserializers[request.typeName](request.bytes);\n"
+    "    port.postMessage({ id: request.id, value });\n"
+    "  } catch (error) {\n"
+    "    port.postMessage({ id: request.id, error: String(error) });\n"
+    "  }\n"
+    "});\n");
+
   return true;
 }
 
-bool GrpcNodeGenerator::PrintServiceMethodDefinition
-  ( google::protobuf::io::Printer&              printer
-  , const GrpcNodeGeneratorOptions&             options
-  , const google::protobuf::MethodDescriptor*   method
-  , std::string*                                error
+bool GrpcNodeGenerator::GeneratePolicyReport
+  ( const google::protobuf::FileDescriptor*        file
+  , const GrpcNodeGeneratorOptions&                options
+  , google::protobuf::compiler::GeneratorContext*  context
+  , std::string*                                   error
   ) const
 {
-  const Descriptor* inputType = method->input_type();
-  const Descriptor* outputType = method->output_type();
-  std::map<std::string, std::string> vars;
-  vars["ServiceFullName"] = method->service()->full_name();
-  vars["MethodName"] = method->name();
-  vars["inputType"] = utils::nodeObjectPath(inputType);
-  vars["inputTypeId"] = utils::messageIdentifierName(inputType->full_name());
-  vars["outputType"] = utils::nodeObjectPath(outputType);
-  vars["outputTypeId"] = utils::messageIdentifierName(outputType->full_name());
-  vars["isClientStream"] = method->client_streaming() ? "true" : "false";
-  vars["isServerStream"] = method->server_streaming() ? "true" : "false";
+  std::unique_ptr<ZeroCopyOutputStream> reportOutput(
+    context->Open(utils::removePathExtname(file->name()) + "_grpc_policy.json")
+  );
+  Printer printer(reportOutput.get(), '$');
+
   printer.Print("{\n");
   printer.Indent();
-  printer.Print(vars, "path: '/$ServiceFullName$/$MethodName$',\n");
-  printer.Print(vars, "requestStream: $isClientStream$,\n");
-  printer.Print(vars, "responseStream: $isServerStream$,\n");
-  printer.Print(vars, "requestType: $inputType$,\n");
-  printer.Print(vars, "responseType: $outputType$,\n");
-  printer.Print(vars, "requestSerialize: serialize_$inputTypeId$,\n");
-  printer.Print(vars, "requestDeserialize: deserialize_$inputTypeId$,\n");
-  printer.Print(vars, "responseSerialize: serialize_$outputTypeId$,\n");
-  printer.Print(vars, "responseDeserialize: deserialize_$outputTypeId$,\n");
+  printer.Print("\"proto\": $name$,\n", "name", JsonString(file->name()));
+  printer.Print("\"services\": [\n");
+  printer.Indent();
+
+  for(auto i=0; file->service_count() > i; ++i) {
+    auto service = file->service(i);
+    printer.Print("{\n");
+    printer.Indent();
+    printer.Print("\"service\": $name$,\n",
+      "name", JsonString(service->full_name()));
+    printer.Print("\"methods\": [\n");
+    printer.Indent();
+
+    for(auto j=0; service->method_count() > j; ++j) {
+      auto method = service->method(j);
+      grpc_node::MethodPolicy policy;
+      if(!GetServiceConfigPolicy(method, &policy, error)) {
+        return false;
+      }
+
+      // A method without any field keeps the channel defaults.
+      std::vector<std::string> fields;
+      fields.push_back("\"method\": " + JsonString(method->name()));
+      if(policy.has_timeout()) {
+        fields.push_back("\"timeout\": " +
+          JsonString(utils::durationString(policy.timeout())));
+      }
+      if(policy.has_wait_for_ready()) {
+        fields.push_back(std::string("\"waitForReady\": ") +
+          (policy.wait_for_ready() ? "true" : "false"));
+      }
+      if(policy.has_retry_policy()) {
+        fields.push_back("\"retryPolicy\": { \"maxAttempts\": " +
+          std::to_string(policy.retry_policy().max_attempts()) + " }");
+      }
+      if(policy.has_hedging_policy()) {
+        fields.push_back("\"hedgingPolicy\": { \"maxAttempts\": " +
+          std::to_string(policy.hedging_policy().max_attempts()) + " }");
+      }
+      if(policy.has_compression()) {
+        fields.push_back("\"compression\": " +
+          JsonString(CompressionName(policy.compression())));
+        fields.push_back("\"compressionThresholdBytes\": " +
+          std::to_string(policy.compression_threshold_bytes()));
+      }
+      if(policy.has_max_request_message_bytes()) {
+        fields.push_back("\"maxRequestMessageBytes\": " +
+          std::to_string(policy.max_request_message_bytes()));
+      }
+      if(policy.has_max_response_message_bytes()) {
+        fields.push_back("\"maxResponseMessageBytes\": " +
+          std::to_string(policy.max_response_message_bytes()));
+      }
+      if(policy.has_max_concurrent_calls()) {
+        fields.push_back("\"maxConcurrentCalls\": " +
+          std::to_string(policy.max_concurrent_calls()));
+        fields.push_back("\"maxQueuedCalls\": " +
+          std::to_string(policy.max_queued_calls()));
+      }
+
+      std::string line = "{ ";
+      for(size_t k = 0; fields.size() > k; ++k) {
+        line += (k > 0 ? ", " : "") + fields[k];
+      }
+      printer.Print("$line$ }$comma$\n",
+        "line", line,
+        "comma", service->method_count() > j + 1 ? "," : "");
+    }
+
+    printer.Outdent();
+    printer.Print("]\n");
+    printer.Outdent();
+    printer.Print(file->service_count() > i + 1 ? "},\n" : "}\n");
+  }
+
   printer.Outdent();
-  printer.Print("}");
+  printer.Print("]\n");
+  printer.Outdent();
+  printer.Print("}\n");
 
   return true;
 }
 
-bool GrpcNodeGenerator::PrintServicePromiseClientInterface
-  ( google::protobuf::io::Printer&              printer
-  , const GrpcNodeGeneratorOptions&          options
-  , const google::protobuf::ServiceDescriptor*  service
-  , std::string*                                error
+bool GrpcNodeGenerator::GenerateSizeReport
+  ( const std::vector<const google::protobuf::FileDescriptor*>&  files
+  , const GrpcNodeGeneratorOptions&                             options
+  , google::protobuf::compiler::GeneratorContext*               context
+  , std::string*                                                error
   ) const
 {
-  std::map<std::string, std::string> vars = {
-    {"ServiceName", service->name()}
+  struct ProtoStats {
+    const FileDescriptor* file;
+    int64_t bytes = 0;
+    int64_t moduleBytes = 0;
+    std::set<const FileDescriptor*> pbModules;
   };
 
-  printer.Print(vars, "export interface I$ServiceName$PromiseClient {\n");
-  printer.Indent();
+  SizeReportContext reportContext(context);
+  std::vector<ProtoStats> protos;
+  std::set<const FileDescriptor*> allPbModules;
 
-  auto methodCount = service->method_count();
+  std::unique_ptr<ZeroCopyOutputStream> reportOutput(
+    context->Open("grpc_node_size_report.json")
+  );
+  Printer printer(reportOutput.get(), '$');
 
-  for(auto i=0; methodCount > i; ++i) {
-    auto method = service->method(i);
-    auto inputType = method->input_type();
-    auto outputType = method->output_type();
+  printer.Print("{\n");
+  printer.Indent();
+  printer.Print("\"protos\": [\n");
+  printer.Indent();
 
-    vars["methodName"] = GetMethodInterfaceName(method);
-    vars["RequestType"] = utils::nodeObjectPath(inputType);
-    vars["ResponseType"] = utils::nodeObjectPath(outputType);
+  for(size_t f = 0; files.size() > f; ++f) {
+    auto file = files[f];
+    auto first = reportContext.outputs().size();
 
-    if(method->client_streaming() && method->server_streaming()) {
+    // What each generated module contains, keyed by its filename.
+    GrpcNodeModuleStatsMap modules;
+    if(!GenerateFile(file, options, &reportContext, error, &modules)) {
+      if(error->empty()) {
+        *error = "Code generator returned false but provided no error "
+          "description.";
+      }
+      *error = file->name() + ": " + *error;
+      return false;
+    }
 
-    } else
-    if(method->client_streaming()) {
+    ProtoStats proto;
+    proto.file = file;
 
-    } else
-    if(method->server_streaming()) {
+    printer.Print("{\n");
+    printer.Indent();
+    printer.Print("\"proto\": $name$,\n", "name", JsonString(file->name()));
+    printer.Print("\"outputs\": [\n");
+    printer.Indent();
 
-    } else {
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, "): Promise<$ResponseType$>;\n");
-      printer.Outdent();
+    for(auto i = first; reportContext.outputs().size() > i; ++i) {
+      const auto& output = reportContext.outputs()[i];
+      proto.bytes += output.bytes;
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
-      printer.Print(vars, "): Promise<$ResponseType$>;\n");
-      printer.Outdent();
+      printer.Print("{ \"file\": $file$, \"bytes\": $bytes$",
+        "file", JsonString(output.filename),
+        "bytes", std::to_string(output.bytes));
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
-      printer.Print(vars, ", options: grpc.CallOptions | null\n");
-      printer.Print(vars, "): Promise<$ResponseType$>;\n\n");
-      printer.Outdent();
+      auto it = modules.find(output.filename);
+      if(it != modules.end()) {
+        const auto& module = it->second;
+        proto.moduleBytes += output.bytes;
+        proto.pbModules.insert(
+          module.pbModules.begin(), module.pbModules.end());
+        printer.Print(
+          ", \"transformers\": $transformers$, \"services\": $services$, "
+          "\"methods\": $methods$, \"imports\": $imports$, "
+          "\"transitivePbModules\": $pbModules$",
+          "transformers", std::to_string(module.transformers),
+          "services", std::to_string(module.services),
+          "methods", std::to_string(module.methods),
+          "imports", std::to_string(module.imports),
+          "pbModules", std::to_string(module.pbModules.size()));
+      }
+
+      printer.Print(
+        reportContext.outputs().size() > i + 1 ? " },\n" : " }\n");
     }
+
+    printer.Outdent();
+    printer.Print("],\n");
+    printer.Print("\"bytes\": $bytes$,\n",
+      "bytes", std::to_string(proto.bytes));
+    printer.Print("\"moduleBytes\": $bytes$,\n",
+      "bytes", std::to_string(proto.moduleBytes));
+    printer.Print("\"transitivePbModules\": $pbModules$\n",
+      "pbModules", std::to_string(proto.pbModules.size()));
+    printer.Outdent();
+    printer.Print(files.size() > f + 1 ? "},\n" : "}\n");
+
+    allPbModules.insert(proto.pbModules.begin(), proto.pbModules.end());
+    protos.push_back(proto);
   }
 
   printer.Outdent();
-  printer.Print(vars, "}\n\n");
+  printer.Print("],\n");
+
+  int64_t totalBytes = 0;
+  for(const auto& proto : protos) {
+    totalBytes += proto.bytes;
+  }
+  printer.Print("\"totals\": { \"protos\": $protos$, \"outputs\": $outputs$, "
+    "\"bytes\": $bytes$, \"transitivePbModules\": $pbModules$ },\n",
+    "protos", std::to_string(protos.size()),
+    "outputs", std::to_string(reportContext.outputs().size()),
+    "bytes", std::to_string(totalBytes),
+    "pbModules", std::to_string(allPbModules.size()));
+
+  // Ranked by what ships in the _grpc_pb modules, not benches or reports;
+  // the module graph they drag in breaks ties.
+  std::stable_sort(protos.begin(), protos.end(),
+    [](const ProtoStats& a, const ProtoStats& b) {
+      if(a.moduleBytes != b.moduleBytes) {
+        return a.moduleBytes > b.moduleBytes;
+      }
+      return a.pbModules.size() > b.pbModules.size();
+    });
+  if(protos.size() > options.sizeReportTop()) {
+    protos.resize(options.sizeReportTop());
+  }
+
+  printer.Print("\"worstOffenders\": [\n");
+  printer.Indent();
+  for(size_t i = 0; protos.size() > i; ++i) {
+    printer.Print("{ \"proto\": $name$, \"moduleBytes\": $bytes$, "
+      "\"transitivePbModules\": $pbModules$ }$comma$\n",
+      "name", JsonString(protos[i].file->name()),
+      "bytes", std::to_string(protos[i].moduleBytes),
+      "pbModules", std::to_string(protos[i].pbModules.size()),
+      "comma", protos.size() > i + 1 ? "," : "");
+  }
+  printer.Outdent();
+  printer.Print("]\n");
+  printer.Outdent();
+  printer.Print("}\n");
 
   return true;
 }
 
-bool GrpcNodeGenerator::PrintServiceClientClass
-  ( google::protobuf::io::Printer&              printer
-  , const GrpcNodeGeneratorOptions&          options
-  , const google::protobuf::ServiceDescriptor*  service
-  , std::string*                                error
+bool GrpcNodeGenerator::GenerateServiceBench
+  ( const google::protobuf::ServiceDescriptor*     service
+  , const GrpcNodeGeneratorOptions&                options
+  , google::protobuf::compiler::GeneratorContext*  context
+  , std::string*                                   error
   ) const
 {
+  auto file = service->file();
+  auto benchFilename = utils::removePathExtname(file->name()) + "_" +
+    service->name() + "_grpc_bench.ts";
+
+  std::unique_ptr<ZeroCopyOutputStream> benchOutput(
+    context->Open(benchFilename)
+  );
+  Printer printer(benchOutput.get(), '$');
+
   std::map<std::string, std::string> vars = {
     {"ServiceName", service->name()},
-    {"ServiceFullName", service->full_name()}
+    {"ServiceFullName", service->full_name()},
+    {"ClientModule", "./" +
+      GetBasename(utils::removePathExtname(file->name())) + "_grpc_pb"},
+    {"Serializer", options.messageBackend().Name()}
   };
 
-  printer.Print(vars,
-    "export interface I$ServiceName$Client extends grpc.Client {\n");
-  printer.Indent();
-
-  auto methodCount = service->method_count();
-
-  for(auto i=0; methodCount > i; ++i) {
-    auto method = service->method(i);
-    auto inputType = method->input_type();
-    auto outputType = method->output_type();
+  // Responses are synthesized too, for the --loopback server.
+  std::map<std::string, const Descriptor*> messages;
+  for(auto i=0; service->method_count() > i; ++i) {
+    GetReachableMessages(service->method(i)->input_type(), &messages);
+    GetReachableMessages(service->method(i)->output_type(), &messages);
+  }
 
-    vars["methodName"] = GetMethodInterfaceName(method);
-    vars["RequestType"] = utils::nodeObjectPath(inputType);
-    vars["ResponseType"] = utils::nodeObjectPath(outputType);
-    
-    if(method->client_streaming() && method->server_streaming()) {
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars,
-        "(): grpc.ClientDuplexStream<$RequestType$, $ResponseType$>;\n");
-      printer.Outdent();
+  std::set<std::string> protoFilenames;
+  for(const auto& it : messages) {
+    protoFilenames.insert(it.second->file()->name());
+  }
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars,
-        "(metadata: grpc.Metadata | null): "
-        "grpc.ClientDuplexStream<$RequestType$, $ResponseType$>;\n");
-      printer.Outdent();
-    } else
-    if(method->client_streaming()) {
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "(): grpc.ClientWritableStream<$RequestType$>;\n");
-      printer.Outdent();
+  printer.Print(vars,
+    "// GENERATED CODE -- load-test harness for $ServiceFullName$\n"
+    "//\n"
+    "// Usage: node <this file> --target=localhost:50051 --concurrency=16\n"
+    "//   --rate=0 --duration=10 --messages=10 --payload=16 --repeated=3\n"
+    "//   [--method=name,...] [--codec=true] [--loopback=true]\n"
+    "//\n"
+    "// --rate limits calls per second across all workers (0 = unlimited).\n"
+    "// --codec=true only measures request encoding and decoding, without a\n"
+    "// server, to compare serializer backends.\n"
+    "// --loopback=true ignores --target and serves the calls from an\n"
+    "// in-process server on 127.0.0.1 answering with synthesized messages.\n"
+    "// Results are printed to stdout as JSON.\n\n");
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "(metadata: grpc.Metadata | null): grpc.ClientWritableStream<$RequestType$>;\n");
-      printer.Outdent();
-    } else
-    if(method->server_streaming()) {
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, "): grpc.ClientReadableStream<$ResponseType$>;\n");
-      printer.Outdent();
+  PrintGrpcImport(printer, options);
+  for(const auto& protoFilename : protoFilenames) {
+    PrintMessageModuleImport(printer, options, file->name(), protoFilename);
+  }
+  printer.Print(vars,
+    "import { $ServiceName$Client, I$ServiceName$Client, $ServiceName$Service,\n"
+    "  I$ServiceName$Implementation } from '$ClientModule$';\n\n");
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
-      printer.Print(vars, "): grpc.ClientReadableStream<$ResponseType$>;\n");
-      printer.Outdent();
-    } else {
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
-      printer.Print(vars, "): void;\n");
-      printer.Outdent();
+  printer.Print(
+    "export interface BenchOptions {\n"
+    "  target: string;\n"
+    "  concurrency: number;\n"
+    "  rate: number;\n"
+    "  durationSeconds: number;\n"
+    "  messagesPerStream: number;\n"
+    "  payloadBytes: number;\n"
+    "  repeatedCount: number;\n"
+    "  methods: string[];\n"
+    "  codec: boolean;\n"
+    "  loopback: boolean;\n"
+    "}\n\n"
+    "export interface MethodResult {\n"
+    "  method: string;\n"
+    "  type: string;\n"
+    "  calls: number;\n"
+    "  errors: number;\n"
+    "  messages: number;\n"
+    "  durationSeconds: number;\n"
+    "  callsPerSecond: number;\n"
+    "  messagesPerSecond: number;\n"
+    "  latencyMs: {\n"
+    "    min: number, mean: number, p50: number, p90: number,\n"
+    "    p99: number, p999: number, max: number };\n"
+    "}\n\n"
+    "export interface CodecResult {\n"
+    "  method: string;\n"
+    "  requestBytes: number;\n"
+    "  encodesPerSecond: number;\n"
+    "  decodesPerSecond: number;\n"
+    "}\n\n");
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
-      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
-      printer.Print(vars, "): void;\n");
-      printer.Outdent();
+  for(const auto& it : messages) {
+    if(!PrintSyntheticMessageBuilder(printer, options, it.second, error)) {
+      return false;
+    }
+  }
 
-      printer.Print(vars, "$methodName$\n");
-      printer.Indent();
-      printer.Print(vars, "( request: $RequestType$\n");
-      printer.Print(vars, ", metadata: grpc.Metadata | null\n");
-      printer.Print(vars, ", options: grpc.CallOptions | null\n");
-      printer.Print(vars, ", callback: grpc.requestCallback<$ResponseType$>\n");
-      printer.Print(vars, "): void;\n\n");
-      printer.Outdent();
+  printer.Print(vars,
+    "// Each prepared call resolves with the number of messages exchanged.\n"
+    "type PreparedCall = (client: I$ServiceName$Client) => Promise<number>;\n\n"
+    "const methods: {\n"
+    "  [name: string]: {\n"
+    "    type: string,\n"
+    "    request: (options: BenchOptions) => any,\n"
+    "    prepare: (options: BenchOptions) => PreparedCall,\n"
+    "  },\n"
+    "} = {\n");
+  printer.Indent();
+
+  for(auto i=0; service->method_count() > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = utils::lowercaseFirstLetter(method->name());
+    vars["inputTypeId"] = utils::messageIdentifierName(
+      method->input_type()->full_name());
+
+    printer.Print(vars, "'$methodName$': {\n");
+    printer.Indent();
+    printer.Print(vars,
+      "request: options => synthesize_$inputTypeId$(options, 0),\n");
+
+    switch(utils::getMethodType(method)) {
+      case utils::METHODTYPE_NO_STREAMING:
+        printer.Print(vars,
+          "type: 'unary',\n"
+          "prepare: options => {\n"
+          "  const request = synthesize_$inputTypeId$(options, 0);\n"
+          "  return client => new Promise<number>((resolve, reject) =>\n"
+          "    client.$methodName$(request, err => err ? reject(err) : resolve(1)));\n"
+          "},\n");
+        break;
+      case utils::METHODTYPE_SERVER_STREAMING:
+        printer.Print(vars,
+          "type: 'server_streaming',\n"
+          "prepare: options => {\n"
+          "  const request = synthesize_$inputTypeId$(options, 0);\n"
+          "  return client => new Promise<number>((resolve, reject) => {\n"
+          "    let received = 0;\n"
+          "    const call = client.$methodName$(request);\n"
+          "    call.on('data', () => received++);\n"
+          "    call.on('error', reject);\n"
+          "    call.on('end', () => resolve(received));\n"
+          "  });\n"
+          "},\n");
+        break;
+      case utils::METHODTYPE_CLIENT_STREAMING:
+        // The typed client has no callback overload for client streaming.
+        printer.Print(vars,
+          "type: 'client_streaming',\n"
+          "prepare: options => {\n"
+          "  const request = synthesize_$inputTypeId$(options, 0);\n"
+          "  return client => new Promise<number>((resolve, reject) => {\n"
+          "    const call: grpc.ClientWritableStream<any> =\n"
+          "      (<any>client).$methodName$((err: grpc.ServiceError | null) =>\n"
+          "        err ? reject(err) : resolve(options.messagesPerStream + 1));\n"
+          "    for (let i = 0; i < options.messagesPerStream; i++) {\n"
+          "      call.write(request);\n"
+          "    }\n"
+          "    call.end();\n"
+          "  });\n"
+          "},\n");
+        break;
+      case utils::METHODTYPE_BIDI_STREAMING:
+        printer.Print(vars,
+          "type: 'bidi_streaming',\n"
+          "prepare: options => {\n"
+          "  const request = synthesize_$inputTypeId$(options, 0);\n"
+          "  return client => new Promise<number>((resolve, reject) => {\n"
+          "    let received = 0;\n"
+          "    const call = client.$methodName$();\n"
+          "    call.on('data', () => received++);\n"
+          "    call.on('error', reject);\n"
+          "    call.on('end', () => resolve(received + options.messagesPerStream));\n"
+          "    for (let i = 0; i < options.messagesPerStream; i++) {\n"
+          "      call.write(request);\n"
+          "    }\n"
+          "    call.end();\n"
+          "  });\n"
+          "},\n");
+        break;
     }
+
+    printer.Outdent();
+    printer.Print("},\n");
   }
 
   printer.Outdent();
-  printer.Print(vars, "}\n\n");
+  printer.Print("};\n\n");
 
-  printer.Print(vars, "export interface $ServiceName$ClientConstructor {\n");
+  printer.Print(vars,
+    "// Answers every call with synthesized responses, so only the generated\n"
+    "// code and the gRPC runtime are measured.\n"
+    "function loopbackImplementation\n"
+    "  ( options: BenchOptions\n"
+    "  ): I$ServiceName$Implementation {\n");
   printer.Indent();
-  printer.Print(vars, "new ("
-    "address: string, "
-    "credentials: grpc.ChannelCredentials, "
-    "options?: object"
-    "): I$ServiceName$Client;\n");
+  for(auto i=0; service->method_count() > i; ++i) {
+    auto method = service->method(i);
+    vars["responseName"] =
+      utils::lowercaseFirstLetter(method->name()) + "Response";
+    vars["outputTypeId"] = utils::messageIdentifierName(
+      method->output_type()->full_name());
+    printer.Print(vars,
+      "const $responseName$ = synthesize_$outputTypeId$(options, 0);\n");
+  }
+  printer.Print("return {\n");
+  printer.Indent();
+  for(auto i=0; service->method_count() > i; ++i) {
+    auto method = service->method(i);
+    vars["methodName"] = GetMethodInterfaceName(method);
+    vars["responseName"] =
+      utils::lowercaseFirstLetter(method->name()) + "Response";
+
+    switch(utils::getMethodType(method)) {
+      case utils::METHODTYPE_NO_STREAMING:
+        printer.Print(vars,
+          "$methodName$: (call: any, callback: any) =>\n"
+          "  callback(null, $responseName$),\n");
+        break;
+      case utils::METHODTYPE_SERVER_STREAMING:
+        printer.Print(vars,
+          "$methodName$: (call: any) => {\n"
+          "  for (let i = 0; i < options.messagesPerStream; i++) {\n"
+          "    call.write($responseName$);\n"
+          "  }\n"
+          "  call.end();\n"
+          "},\n");
+        break;
+      case utils::METHODTYPE_CLIENT_STREAMING:
+        printer.Print(vars,
+          "$methodName$: (call: any, callback: any) => {\n"
+          "  call.on('data', () => undefined);\n"
+          "  call.on('end', () => callback(null, $responseName$));\n"
+          "},\n");
+        break;
+      case utils::METHODTYPE_BIDI_STREAMING:
+        printer.Print(vars,
+          "$methodName$: (call: any) => {\n"
+          "  call.on('data', () => call.write($responseName$));\n"
+          "  call.on('end', () => call.end());\n"
+          "},\n");
+        break;
+    }
+  }
+  printer.Outdent();
+  printer.Print("};\n");
   printer.Outdent();
   printer.Print("}\n\n");
 
   printer.Print(vars,
-    "export const $ServiceName$Client = <$ServiceName$ClientConstructor>\n");
-  printer.Indent();
+    "async function startLoopback\n"
+    "  ( options: BenchOptions\n"
+    "  ): Promise<{ target: string, server: grpc.Server }> {\n"
+    "  const server = new grpc.Server();\n"
+    "  server.addService(<any>$ServiceName$Service, "
+    "<any>loopbackImplementation(options));\n");
+  if(options.grpcJs()) {
+    printer.Print(
+      "  const port = await new Promise<number>((resolve, reject) =>\n"
+      "    server.bindAsync('127.0.0.1:0', grpc.ServerCredentials.createInsecure(),\n"
+      "      (err, port) => err ? reject(err) : resolve(port)));\n");
+  } else {
+    printer.Print(
+      "  const port = server.bind('127.0.0.1:0',\n"
+      "    grpc.ServerCredentials.createInsecure());\n");
+  }
+  printer.Print(
+    "  server.start();\n"
+    "  return { target: '127.0.0.1:' + port, server };\n"
+    "}\n\n");
+
   printer.Print(vars,
-    "grpc.makeGenericClientConstructor("
-      "$ServiceName$Service, '$ServiceFullName$', {});\n\n");
-  printer.Outdent();
+    "function now(): number {\n"
+    "  const [seconds, nanos] = process.hrtime();\n"
+    "  return seconds * 1e3 + nanos / 1e6;\n"
+    "}\n\n"
+    "function percentile(sorted: number[], q: number): number {\n"
+    "  if (sorted.length === 0) {\n"
+    "    return 0;\n"
+    "  }\n"
+    "  return sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];\n"
+    "}\n\n"
+    "async function runMethod\n"
+    "  ( client: I$ServiceName$Client\n"
+    "  , name: string\n"
+    "  , options: BenchOptions\n"
+    "  ): Promise<MethodResult> {\n"
+    "  const call = methods[name].prepare(options);\n"
+    "  const latencies: number[] = [];\n"
+    "  let errors = 0;\n"
+    "  let messages = 0;\n"
+    "\n"
+    "  const startMs = now();\n"
+    "  const endMs = startMs + options.durationSeconds * 1000;\n"
+    "  const interval = options.rate > 0 ? 1000 / options.rate : 0;\n"
+    "  let nextSlot = startMs;\n"
+    "\n"
+    "  const worker = async () => {\n"
+    "    for (;;) {\n"
+    "      // With a rate limit latency is measured from the scheduled start,\n"
+    "      // so a slow server is not hidden by delayed sends.\n"
+    "      let callStart = now();\n"
+    "      if (interval > 0) {\n"
+    "        const slot = nextSlot;\n"
+    "        nextSlot += interval;\n"
+    "        if (slot >= endMs) {\n"
+    "          return;\n"
+    "        }\n"
+    "        if (slot > callStart) {\n"
+    "          await new Promise(resolve => setTimeout(resolve, slot - callStart));\n"
+    "        }\n"
+    "        callStart = slot;\n"
+    "      } else if (callStart >= endMs) {\n"
+    "        return;\n"
+    "      }\n"
+    "\n"
+    "      try {\n"
+    "        // Not `messages += await ...`, which would add to a stale total.\n"
+    "        const exchanged = await call(client);\n"
+    "        messages += exchanged;\n"
+    "        latencies.push(now() - callStart);\n"
+    "      } catch (err) {\n"
+    "        errors++;\n"
+    "      }\n"
+    "    }\n"
+    "  };\n"
+    "\n"
+    "  const workers: Promise<void>[] = [];\n"
+    "  for (let i = 0; i < options.concurrency; i++) {\n"
+    "    workers.push(worker());\n"
+    "  }\n"
+    "  await Promise.all(workers);\n"
+    "\n"
+    "  const durationSeconds = (now() - startMs) / 1000;\n"
+    "  latencies.sort((a, b) => a - b);\n"
+    "  const total = latencies.reduce((sum, latency) => sum + latency, 0);\n"
+    "  return {\n"
+    "    method: name,\n"
+    "    type: methods[name].type,\n"
+    "    calls: latencies.length,\n"
+    "    errors,\n"
+    "    messages,\n"
+    "    durationSeconds,\n"
+    "    callsPerSecond: latencies.length / durationSeconds,\n"
+    "    messagesPerSecond: messages / durationSeconds,\n"
+    "    latencyMs: {\n"
+    "      min: latencies.length > 0 ? latencies[0] : 0,\n"
+    "      mean: latencies.length > 0 ? total / latencies.length : 0,\n"
+    "      p50: percentile(latencies, 0.5),\n"
+    "      p90: percentile(latencies, 0.9),\n"
+    "      p99: percentile(latencies, 0.99),\n"
+    "      p999: percentile(latencies, 0.999),\n"
+    "      max: percentile(latencies, 1),\n"
+    "    },\n"
+    "  };\n"
+    "}\n\n"
+    "// Time-boxed encode and decode loops over the method's own transformers.\n"
+    "function runCodec(name: string, options: BenchOptions): CodecResult {\n"
+    "  const definition = (<any>$ServiceName$Service)[name];\n"
+    "  const request = methods[name].request(options);\n"
+    "  const bytes = definition.requestSerialize(request);\n"
+    "  const budgetMs = options.durationSeconds * 500;\n"
+    "\n"
+    "  const measure = (operation: () => void) => {\n"
+    "    let count = 0;\n"
+    "    const startMs = now();\n"
+    "    while (now() - startMs < budgetMs) {\n"
+    "      for (let i = 0; i < 100; i++) {\n"
+    "        operation();\n"
+    "      }\n"
+    "      count += 100;\n"
+    "    }\n"
+    "    return count / ((now() - startMs) / 1000);\n"
+    "  };\n"
+    "\n"
+    "  return {\n"
+    "    method: name,\n"
+    "    requestBytes: bytes.length,\n"
+    "    encodesPerSecond: measure(() => definition.requestSerialize(request)),\n"
+    "    decodesPerSecond: measure(() => definition.requestDeserialize(bytes)),\n"
+    "  };\n"
+    "}\n\n"
+    "export function parseArgs(argv: string[]): BenchOptions {\n"
+    "  const options: BenchOptions = {\n"
+    "    target: 'localhost:50051',\n"
+    "    concurrency: 16,\n"
+    "    rate: 0,\n"
+    "    durationSeconds: 10,\n"
+    "    messagesPerStream: 10,\n"
+    "    payloadBytes: 16,\n"
+    "    repeatedCount: 3,\n"
+    "    methods: [],\n"
+    "    codec: false,\n"
+    "    loopback: false,\n"
+    "  };\n"
+    "\n"
+    "  for (const arg of argv) {\n"
+    "    const match = /^--([a-z]+)=(.*)$$/.exec(arg);\n"
+    "    if (match === null) {\n"
+    "      throw new Error('Unexpected argument ' + arg);\n"
+    "    }\n"
+    "    const value = match[2];\n"
+    "    switch (match[1]) {\n"
+    "      case 'target': options.target = value; break;\n"
+    "      case 'concurrency': options.concurrency = Number(value); break;\n"
+    "      case 'rate': options.rate = Number(value); break;\n"
+    "      case 'duration': options.durationSeconds = Number(value); break;\n"
+    "      case 'messages': options.messagesPerStream = Number(value); break;\n"
+    "      case 'payload': options.payloadBytes = Number(value); break;\n"
+    "      case 'repeated': options.repeatedCount = Number(value); break;\n"
+    "      case 'method': options.methods = value.split(','); break;\n"
+    "      case 'codec': options.codec = value === 'true'; break;\n"
+    "      case 'loopback': options.loopback = value === 'true'; break;\n"
+    "      default: throw new Error('Unknown option --' + match[1]);\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  return options;\n"
+    "}\n\n"
+    "function selected(options: BenchOptions): string[] {\n"
+    "  return Object.keys(methods).filter(name =>\n"
+    "    options.methods.length === 0 || options.methods.indexOf(name) >= 0);\n"
+    "}\n\n"
+    "export function runCodecs(options: BenchOptions): CodecResult[] {\n"
+    "  return selected(options).map(name => runCodec(name, options));\n"
+    "}\n\n"
+    "export async function run(options: BenchOptions): Promise<MethodResult[]> {\n"
+    "  const loopback = options.loopback ? await startLoopback(options) : null;\n"
+    "  const client = new $ServiceName$Client(\n"
+    "    loopback ? loopback.target : options.target,\n"
+    "    grpc.credentials.createInsecure());\n"
+    "  const results: MethodResult[] = [];\n"
+    "  try {\n"
+    "    for (const name of selected(options)) {\n"
+    "      results.push(await runMethod(client, name, options));\n"
+    "    }\n"
+    "  } finally {\n"
+    "    client.close();\n"
+    "    if (loopback) {\n"
+    "      loopback.server.forceShutdown();\n"
+    "    }\n"
+    "  }\n"
+    "  return results;\n"
+    "}\n\n"
+    "if (require.main === module) {\n"
+    "  const options = parseArgs(process.argv.slice(2));\n"
+    "  const results: Promise<Array<MethodResult | CodecResult>> =\n"
+    "    options.codec ? Promise.resolve(runCodecs(options)) : run(options);\n"
+    "  results.then(results => {\n"
+    "    process.stdout.write(JSON.stringify({\n"
+    "      service: '$ServiceFullName$',\n"
+    "      serializer: '$Serializer$',\n"
+    "      mode: options.codec ? 'codec' : options.loopback ? 'loopback' : 'remote',\n"
+    "      results,\n"
+    "    }, null, 2) + '\\n');\n"
+    "  }, err => {\n"
+    "    console.error(err);\n"
+    "    process.exit(1);\n"
+    "  });\n"
+    "}\n");
 
   return true;
 }
 
-bool GrpcNodeGenerator::GenerateImports
-  ( google::protobuf::io::Printer&           printer
-  , const GrpcNodeGeneratorOptions&          options
-  , const google::protobuf::FileDescriptor*  file
-  , std::string*                             error
+bool GrpcNodeGenerator::PrintService
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
   ) const
 {
-  std::map<std::string, std::string> vars;
-  printer.Print(vars, "import * as grpc from 'grpc';\n");
+  if(!PrintServiceImplementationInterface(printer, options, service, error)) {
+    return false;
+  }
 
-  auto fileName = file->name();
+  if(!PrintServiceAsyncImplementation(printer, options, service, error)) {
+    return false;
+  }
 
-  if(file->message_type_count() > 0) {
-    std::string filePath = utils::getRelativePath(
-      fileName, GetTsMessageFilename(fileName));
+  if(!PrintServiceDefinition(printer, options, service, error)) {
+    return false;
+  }
 
-    printer.Print("import * as $ModuleAlias$ from '$filePath$';\n", 
-      "ModuleAlias", utils::moduleAlias(file->name()),
-      "filePath", filePath);
+  if(!PrintServiceAdmission(printer, options, service, error)) {
+    return false;
   }
 
-  for (auto i=0; file->dependency_count() > i; ++i) {
-    auto dependency = file->dependency(i);
-    auto dependencyName = dependency->name();
+  if(!PrintServiceConfig(printer, options, service, error)) {
+    return false;
+  }
 
-    std::string filePath = utils::getRelativePath(
-      file->name(), GetTsMessageFilename(dependencyName));
-    printer.Print("import * as $ModuleAlias$ from '$filePath$';\n",
-      "ModuleAlias", utils::moduleAlias(dependencyName),
-      "filePath", filePath);
+  if(!PrintServiceCallPolicy(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceClientClass(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServicePooledClient(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceInProcessClient(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServicePassthrough(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServicePromiseClientInterface(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceCachingClient(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceOffload(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceCallContext(printer, options, service, error)) {
+    return false;
+  }
+
+  if(!PrintServiceChunked(printer, options, service, error)) {
+    return false;
+  }
+
+  return true;
+}
+
+bool GrpcNodeGenerator::GenerateServiceImports
+  ( google::protobuf::io::Printer&              printer
+  , const GrpcNodeGeneratorOptions&             options
+  , const google::protobuf::ServiceDescriptor*  service
+  , std::string*                                error
+  , GrpcNodeModuleStats*                        stats
+  ) const
+{
+  PrintGrpcImport(printer, options, stats);
+  PrintNodeImports(printer, options, stats);
+
+  for(auto imported : GetServiceImportedProtoFiles(service)) {
+    PrintMessageModuleImport(
+      printer, options, service->file()->name(), imported->name());
+    if(stats != nullptr) {
+      ++stats->imports;
+      CollectPbModules(imported, &stats->pbModules);
+    }
   }
 
   printer.Print("\n");
 
-  // auto serviceCount = file->service_count();
+  return true;
+}
 
-  // std::map<std::string, std::set<const Descriptor*>> descriptors;
+bool GrpcNodeGenerator::GenerateSplitServices
+  ( const google::protobuf::FileDescriptor*        file
+  , const GrpcNodeGeneratorOptions&                options
+  , google::protobuf::compiler::GeneratorContext*  context
+  , std::string*                                   error
+  , GrpcNodeModuleStatsMap*                        stats
+  ) const
+{
+  auto serviceCount = file->service_count();
 
-  // for(auto i=0; serviceCount > i; ++i) {
-  //   auto service = file->service(i);
-  //   auto methodCount = service->method_count();
+  for(auto i=0; serviceCount > i; ++i) {
+    auto service = file->service(i);
+    auto filename = GetServiceModuleFilename(service) + ".ts";
+    GrpcNodeModuleStats* module = stats ? &(*stats)[filename] : nullptr;
 
-  //   for(auto i=0; methodCount > i; ++i) {
-  //     auto method = service->method(i);
-  //     auto inputType = method->input_type();
-  //     auto outputType = method->output_type();
+    std::unique_ptr<ZeroCopyOutputStream> serviceOutput(
+      context->Open(filename)
+    );
+    Printer printer(serviceOutput.get(), '$');
 
-  //     auto inputPath = utils::removePathExtname(inputType->file()->name());
-  //     auto outputPath = utils::removePathExtname(outputType->file()->name());
+    printer.Print("// GENERATED CODE\n\n");
 
-  //     if(descriptors.find(inputPath) == descriptors.end()) {
-  //       descriptors.insert({inputPath, {}});
-  //     }
+    if(!GenerateServiceImports(printer, options, service, error, module)) {
+      return false;
+    }
 
-  //     if(descriptors.find(outputPath) == descriptors.end()) {
-  //       descriptors.insert({outputPath, {}});
-  //     }
+    for(const auto& it : GetServiceMessages(service)) {
+      if(!PrintMessageTransformer(
+          printer, options, it.second, error, module)) {
+        return false;
+      }
+    }
 
-  //     descriptors.find(inputPath)->second.insert(inputType);
-  //     descriptors.find(outputPath)->second.insert(outputType);
-  //   }
-  // }
+    if(!PrintRuntimeHelpers(printer, options, {service}, error)) {
+      return false;
+    }
 
-  // for(auto pair : descriptors) {
-  //   auto path = pair.first;
-  //   auto lastSlashIndex = path.find_last_of('/');
-    
-  //   if(lastSlashIndex != std::string::npos) {
-  //     path = path.substr(lastSlashIndex + 1);
-  //   }
+    if(!PrintService(printer, options, service, error)) {
+      return false;
+    }
+    if(module != nullptr) {
+      module->services = 1;
+      module->methods = service->method_count();
+    }
+  }
 
-  //   vars["ImportPath"] = "./" + path + "_pb";
+  // The index only re-exports, so bundlers can drop services that are never
+  // imported.
+  auto indexFilename = utils::removePathExtname(file->name()) + "_grpc_pb.ts";
+  GrpcNodeModuleStats* index = stats ? &(*stats)[indexFilename] : nullptr;
+  std::unique_ptr<ZeroCopyOutputStream> indexOutput(
+    context->Open(indexFilename)
+  );
+  Printer printer(indexOutput.get(), '$');
 
-  //   printer.Print(vars, "import {\n");
-  //   printer.Indent();
+  if(serviceCount == 0) {
+    printer.Print("// GENERATED CODE -- NO SERVICES IN PROTO\n\n");
+    return true;
+  }
 
-  //   for(auto descriptor : pair.second) {
-  //     vars["ImportName"] = descriptor->name();
-  //     printer.Print(vars, "$ImportName$,\n");
-  //   }
+  printer.Print("// GENERATED CODE\n\n");
 
-  //   printer.Outdent();
-  //   printer.Print(vars, "} from '$ImportPath$';\n\n");
-  // }
+  for(auto i=0; serviceCount > i; ++i) {
+    printer.Print("export * from './$ModulePath$';\n",
+      "ModulePath", GetBasename(GetServiceModuleFilename(file->service(i))));
+    if(index != nullptr) {
+      ++index->imports;
+    }
+  }
 
   return true;
 }
@@ -506,8 +5084,43 @@ bool GrpcNodeGenerator::Generate
     return false;
   }
 
+  return GenerateFile(file, options, context, error);
+}
+
+bool GrpcNodeGenerator::GenerateFile
+  ( const google::protobuf::FileDescriptor*        file
+  , const GrpcNodeGeneratorOptions&                options
+  , google::protobuf::compiler::GeneratorContext*  context
+  , std::string*                                   error
+  , GrpcNodeModuleStatsMap*                        stats
+  ) const
+{
+  if(options.bench()) {
+    for(auto i=0; file->service_count() > i; ++i) {
+      if(!GenerateServiceBench(file->service(i), options, context, error)) {
+        return false;
+      }
+    }
+  }
+
+  if(options.policyReport()) {
+    if(!GeneratePolicyReport(file, options, context, error)) {
+      return false;
+    }
+  }
+
+  if(!GenerateOffloadWorker(file, options, context, error)) {
+    return false;
+  }
+
+  if(options.splitServices()) {
+    return GenerateSplitServices(file, options, context, error, stats);
+  }
+
+  auto filename = utils::removePathExtname(file->name()) + "_grpc_pb.ts";
+  GrpcNodeModuleStats* module = stats ? &(*stats)[filename] : nullptr;
   std::unique_ptr<ZeroCopyOutputStream> indexDtsOutput(
-    context->Open(utils::removePathExtname(file->name()) + "_grpc_pb.ts")
+    context->Open(filename)
   );
   Printer printer(indexDtsOutput.get(), '$');
 
@@ -519,36 +5132,59 @@ bool GrpcNodeGenerator::Generate
     printer.Print("// GENERATED CODE\n\n");
   }
 
-  if(!GenerateImports(printer, options, file, error)) {
+  if(!GenerateImports(printer, options, file, error, module)) {
     return false;
   }
 
   std::map<std::string, const Descriptor*> messages = GetAllMessages(file);
   for(const auto& it : messages) {
-    if(!PrintMessageTransformer(printer, options, it.second, error)) {
+    if(!PrintMessageTransformer(printer, options, it.second, error, module)) {
       return false;
     }
   }
 
+  std::vector<const ServiceDescriptor*> services;
   for(auto i=0; serviceCount > i; ++i) {
-    auto service = file->service(i);
-
-    if(!PrintServiceImplementationInterface(printer, options, service, error)) {
-      return false;
-    }
+    services.push_back(file->service(i));
+  }
 
-    if(!PrintServiceDefinition(printer, options, service, error)) {
-      return false;
-    }
+  if(!PrintRuntimeHelpers(printer, options, services, error)) {
+    return false;
+  }
 
-    if(!PrintServiceClientClass(printer, options, service, error)) {
+  for(auto i=0; serviceCount > i; ++i) {
+    if(!PrintService(printer, options, file->service(i), error)) {
       return false;
     }
-
-    if(!PrintServicePromiseClientInterface(printer, options, service, error)) {
-      return false;
+    if(module != nullptr) {
+      ++module->services;
+      module->methods += file->service(i)->method_count();
     }
   }
 
   return true;
 }
+
+bool GrpcNodeGenerator::GenerateAll
+  ( const std::vector<const google::protobuf::FileDescriptor*>&  files
+  , const std::string&                                          parameter
+  , google::protobuf::compiler::GeneratorContext*               context
+  , std::string*                                                error
+  ) const
+{
+  GrpcNodeGeneratorOptions options(parameter);
+
+  if(options.hasError(error)) {
+    return false;
+  }
+
+  if(!CheckOffloadedTypes(files, options, error)) {
+    return false;
+  }
+
+  if(options.sizeReport()) {
+    return GenerateSizeReport(files, options, context, error);
+  }
+
+  return CodeGenerator::GenerateAll(files, parameter, context, error);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/compiler/plugin.h>
 #include <google/protobuf/descriptor.h>
@@ -9,6 +12,20 @@
 
 #include "grpc-node-generator-options.hh"
 
+// What a generated module contains, recorded by the emitters for the
+// size_report option.
+struct GrpcNodeModuleStats {
+  int transformers = 0;
+  int services = 0;
+  int methods = 0;
+  int imports = 0;
+  // _pb modules loaded by the imports, including their dependencies.
+  std::set<const google::protobuf::FileDescriptor*> pbModules;
+};
+
+// GrpcNodeModuleStats of every generated module, keyed by filename.
+typedef std::map<std::string, GrpcNodeModuleStats> GrpcNodeModuleStatsMap;
+
 class GrpcNodeGenerator
   : public google::protobuf::compiler::CodeGenerator
 {
@@ -21,6 +38,15 @@ public:
     , std::string*                                error
     ) const;
 
+  // Prints the async-generator handler interface and the adapter turning it
+  // into a regular implementation for services with streaming responses
+  bool PrintServiceAsyncImplementation
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
   bool PrintServiceDefinition
     ( google::protobuf::io::Printer&              printer
     , const GrpcNodeGeneratorOptions&             options
@@ -41,6 +67,43 @@ public:
     , const GrpcNodeGeneratorOptions&      options
     , const google::protobuf::Descriptor*  descriptor
     , std::string*                         error
+    , GrpcNodeModuleStats*                 stats = nullptr
+    ) const;
+
+  // Prints the admission policy of every method and the wrapper applying
+  // it to an implementation, for the admission_control option
+  bool PrintServiceAdmission
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints the gRPC service config built from the grpc_node method and
+  // service policies. Nothing is printed when no method has a policy.
+  bool PrintServiceConfig
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints <Service>CallPolicy with the compression and message size policy
+  // of each method, and <Service>ServerOptions admitting the largest limits
+  bool PrintServiceCallPolicy
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints limit<Service>Implementation, checking the method size limits
+  // that are tighter than <Service>ServerOptions
+  bool PrintServiceSizeLimits
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
     ) const;
 
   bool PrintServiceClientClass
@@ -50,6 +113,69 @@ public:
     , std::string*                                error
     ) const;
 
+  // Prints a constructor for an I<Service>Client backed by a pool of
+  // channels
+  bool PrintServicePooledClient
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints create<Service>InProcessClient, which serves calls from an
+  // I<Service>Implementation in the same process
+  bool PrintServiceInProcessClient
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints a definition, client and codecs for the service in which every
+  // message is passed through as a raw Buffer
+  bool PrintServicePassthrough
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints the definition variant, server adapter and promise client that
+  // decode offload_deserialize message types on the worker pool
+  bool PrintServiceOffload
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints a promise client that shares responses of NO_SIDE_EFFECTS unary
+  // methods through a single-flight TTL/LRU cache
+  bool PrintServiceCachingClient
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints the call context type, the server adapter handing contexts to
+  // handlers and the client deriving downstream call options from them
+  bool PrintServiceCallContext
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Prints the companion service streaming the methods marked with
+  // (grpc_node.chunked_transfer) in chunks, its server adapter and client
+  bool PrintServiceChunked
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
   bool PrintServicePromiseClientInterface
     ( google::protobuf::io::Printer&              printer
     , const GrpcNodeGeneratorOptions&             options
@@ -62,6 +188,96 @@ public:
     , const GrpcNodeGeneratorOptions&          options
     , const google::protobuf::FileDescriptor*  file
     , std::string*                             error
+    , GrpcNodeModuleStats*                     stats = nullptr
+    ) const;
+
+  // Prints module-local support code needed by the given services under the
+  // current options. Printed once per generated module.
+  bool PrintRuntimeHelpers
+    ( google::protobuf::io::Printer&                                  printer
+    , const GrpcNodeGeneratorOptions&                                 options
+    , const std::vector<const google::protobuf::ServiceDescriptor*>&  services
+    , std::string*                                                    error
+    ) const;
+
+  // Prints a function building a synthetic instance of `descriptor` with
+  // every field populated, used by the load-test harness
+  bool PrintSyntheticMessageBuilder
+    ( google::protobuf::io::Printer&       printer
+    , const GrpcNodeGeneratorOptions&      options
+    , const google::protobuf::Descriptor*  descriptor
+    , std::string*                         error
+    ) const;
+
+  // Writes <proto>_grpc_policy.json, the resolved call policy of every method
+  bool GeneratePolicyReport
+    ( const google::protobuf::FileDescriptor*        file
+    , const GrpcNodeGeneratorOptions&                options
+    , google::protobuf::compiler::GeneratorContext*  context
+    , std::string*                                   error
+    ) const;
+
+  // Emits <proto>_grpc_worker.ts, the module run by the offload pool workers.
+  // It decodes the offloaded message types and loads nothing else.
+  bool GenerateOffloadWorker
+    ( const google::protobuf::FileDescriptor*        file
+    , const GrpcNodeGeneratorOptions&                options
+    , google::protobuf::compiler::GeneratorContext*  context
+    , std::string*                                   error
+    ) const;
+
+  // Generates every file of the request while measuring the output, then
+  // writes grpc_node_size_report.json summarizing it
+  bool GenerateSizeReport
+    ( const std::vector<const google::protobuf::FileDescriptor*>&  files
+    , const GrpcNodeGeneratorOptions&                             options
+    , google::protobuf::compiler::GeneratorContext*               context
+    , std::string*                                                error
+    ) const;
+
+  // Emits <proto>_<Service>_grpc_bench.ts, a standalone load-test harness
+  // driving every method of the service against a target address
+  bool GenerateServiceBench
+    ( const google::protobuf::ServiceDescriptor*     service
+    , const GrpcNodeGeneratorOptions&                options
+    , google::protobuf::compiler::GeneratorContext*  context
+    , std::string*                                   error
+    ) const;
+
+  // Prints the implementation interface, definition and clients of a service
+  bool PrintService
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    ) const;
+
+  // Imports only the modules whose messages are used by `service`
+  bool GenerateServiceImports
+    ( google::protobuf::io::Printer&              printer
+    , const GrpcNodeGeneratorOptions&             options
+    , const google::protobuf::ServiceDescriptor*  service
+    , std::string*                                error
+    , GrpcNodeModuleStats*                        stats = nullptr
+    ) const;
+
+  // Emits one module per service and an index module re-exporting them
+  bool GenerateSplitServices
+    ( const google::protobuf::FileDescriptor*        file
+    , const GrpcNodeGeneratorOptions&                options
+    , google::protobuf::compiler::GeneratorContext*  context
+    , std::string*                                   error
+    , GrpcNodeModuleStatsMap*                        stats = nullptr
+    ) const;
+
+  // Generate with parsed options, recording the contents of each generated
+  // module in `stats` when given
+  bool GenerateFile
+    ( const google::protobuf::FileDescriptor*        file
+    , const GrpcNodeGeneratorOptions&                options
+    , google::protobuf::compiler::GeneratorContext*  context
+    , std::string*                                   error
+    , GrpcNodeModuleStatsMap*                        stats = nullptr
     ) const;
 
   bool Generate
@@ -71,4 +287,11 @@ public:
     , std::string*                                   error
     ) const override;
 
+  bool GenerateAll
+    ( const std::vector<const google::protobuf::FileDescriptor*>&  files
+    , const std::string&                                          parameter
+    , google::protobuf::compiler::GeneratorContext*               context
+    , std::string*                                                error
+    ) const override;
+
 };
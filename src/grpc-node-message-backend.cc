@@ -0,0 +1,301 @@
+#include "grpc-node-message-backend.hh"
+
+#include "grpc-node-generator-utils.hh"
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::io::Printer;
+
+namespace utils = GrpcNodeGeneratorUtils;
+
+namespace {
+  // Classes generated by protoc --js_out=import_style=commonjs,binary into
+  // <proto>_pb.js, with accessors and serializeBinary/deserializeBinary.
+  class GoogleProtobufBackend : public GrpcNodeMessageBackend {
+  public:
+    std::string Name
+      () const override
+    {
+      return "google-protobuf";
+    }
+
+    std::string ModuleFilename
+      ( const std::string& protoFilename
+      ) const override
+    {
+      return utils::stripProto(protoFilename) + "_pb";
+    }
+
+    std::string ModuleAlias
+      ( const std::string& protoFilename
+      ) const override
+    {
+      return utils::moduleAlias(protoFilename);
+    }
+
+    std::string TypePath
+      ( const Descriptor* descriptor
+      ) const override
+    {
+      return utils::nodeObjectPath(descriptor);
+    }
+
+    void PrintSerializerBody
+      ( Printer&            printer
+      , const std::string&  typePath
+      ) const override
+    {
+      printer.Print("return Buffer.from(arg.serializeBinary());\n");
+    }
+
+    void PrintDeserializerBody
+      ( Printer&            printer
+      , const std::string&  typePath
+      ) const override
+    {
+      printer.Print(
+        "return $TypePath$.deserializeBinary(new Uint8Array(buffer_arg));\n",
+        "TypePath", typePath);
+    }
+
+    // The array representation is the message's own storage, so rebuilding
+    // it does not parse again.
+    std::string CloneableExpression
+      ( const std::string&  typePath
+      , const std::string&  message
+      ) const override
+    {
+      return message + ".toArray()";
+    }
+
+    std::string FromCloneableExpression
+      ( const std::string&  typePath
+      , const std::string&  value
+      ) const override
+    {
+      return "new (<any>" + typePath + ")(" + value + ")";
+    }
+
+    // A copy of the field array; setting a field replaces its slot.
+    std::string ShallowCopyExpression
+      ( const std::string&  typePath
+      , const std::string&  message
+      ) const override
+    {
+      return "<" + typePath + ">new (<any>" + typePath + ")(" + message +
+        ".toArray().slice())";
+    }
+
+    std::string GetFieldExpression
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      ) const override
+    {
+      std::string getter = "get" + utils::jsFieldName(field);
+      if(field->is_repeated()) {
+        getter += "List";
+      }
+      if(field->type() == FieldDescriptor::TYPE_BYTES) {
+        getter += "_asU8";
+      }
+      return message + "." + getter + "()";
+    }
+
+    std::string EncodedSizeExpression
+      ( const std::string& message
+      ) const override
+    {
+      return message + ".serializeBinary().length";
+    }
+
+    std::string SetFieldStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      value
+      ) const override
+    {
+      return message + ".set" + utils::jsFieldName(field) + "(" + value + ");";
+    }
+
+    std::string SetRepeatedFieldStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      values
+      ) const override
+    {
+      return message + ".set" + utils::jsFieldName(field) + "List(" +
+        values + ");";
+    }
+
+    std::string SetMapEntryStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      key
+      , const std::string&      value
+      ) const override
+    {
+      return message + ".get" + utils::jsFieldName(field) + "Map().set(" +
+        key + ", " + value + ");";
+    }
+  };
+
+  // Static classes generated by pbjs -t static-module -w commonjs into
+  // <proto>_pbjs.js, with pbts typings next to it. The module exports the
+  // root namespace, so messages are reached through their package.
+  class ProtobufjsBackend : public GrpcNodeMessageBackend {
+  private:
+    // protobufjs' default property naming (util.camelCase)
+    static std::string PropertyName
+      ( const FieldDescriptor* field
+      )
+    {
+      const std::string& name = field->name();
+      std::string result;
+      for(size_t i = 0; name.size() > i; ++i) {
+        if(i > 0 && name[i] == '_' && name.size() > i + 1 &&
+           name[i + 1] >= 'a' && name[i + 1] <= 'z') {
+          result += static_cast<char>(name[++i] - 'a' + 'A');
+        } else {
+          result += name[i];
+        }
+      }
+      return result;
+    }
+
+  public:
+    std::string Name
+      () const override
+    {
+      return "protobufjs";
+    }
+
+    std::string ModuleFilename
+      ( const std::string& protoFilename
+      ) const override
+    {
+      return utils::stripProto(protoFilename) + "_pbjs";
+    }
+
+    std::string ModuleAlias
+      ( const std::string& protoFilename
+      ) const override
+    {
+      return utils::moduleAlias(protoFilename) + "js";
+    }
+
+    std::string TypePath
+      ( const Descriptor* descriptor
+      ) const override
+    {
+      return ModuleAlias(descriptor->file()->name()) + "." +
+        descriptor->full_name();
+    }
+
+    // encode() already yields a Buffer on Node.js; other Uint8Arrays are
+    // wrapped without copying.
+    void PrintSerializerBody
+      ( Printer&            printer
+      , const std::string&  typePath
+      ) const override
+    {
+      printer.Print(
+        "const bytes = $TypePath$.encode(arg).finish();\n"
+        "return Buffer.isBuffer(bytes) ? bytes :\n"
+        "  Buffer.from(bytes.buffer, bytes.byteOffset, bytes.byteLength);\n",
+        "TypePath", typePath);
+    }
+
+    void PrintDeserializerBody
+      ( Printer&            printer
+      , const std::string&  typePath
+      ) const override
+    {
+      printer.Print("return $TypePath$.decode(buffer_arg);\n",
+        "TypePath", typePath);
+    }
+
+    std::string CloneableExpression
+      ( const std::string&  typePath
+      , const std::string&  message
+      ) const override
+    {
+      return typePath + ".toObject(" + message + ")";
+    }
+
+    std::string FromCloneableExpression
+      ( const std::string&  typePath
+      , const std::string&  value
+      ) const override
+    {
+      return typePath + ".fromObject(" + value + ")";
+    }
+
+    // The constructor copies the own properties of its argument.
+    std::string ShallowCopyExpression
+      ( const std::string&  typePath
+      , const std::string&  message
+      ) const override
+    {
+      return "new " + typePath + "(" + message + ")";
+    }
+
+    std::string GetFieldExpression
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      ) const override
+    {
+      return message + "." + PropertyName(field);
+    }
+
+    // Static classes keep encode() on the constructor.
+    std::string EncodedSizeExpression
+      ( const std::string& message
+      ) const override
+    {
+      return "(<any>" + message + ").constructor.encode(" + message +
+        ").finish().length";
+    }
+
+    std::string SetFieldStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      value
+      ) const override
+    {
+      return message + "." + PropertyName(field) + " = " + value + ";";
+    }
+
+    std::string SetRepeatedFieldStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      values
+      ) const override
+    {
+      return message + "." + PropertyName(field) + " = " + values + ";";
+    }
+
+    std::string SetMapEntryStatement
+      ( const FieldDescriptor*  field
+      , const std::string&      message
+      , const std::string&      key
+      , const std::string&      value
+      ) const override
+    {
+      return message + "." + PropertyName(field) + "[" + key + "] = " +
+        value + ";";
+    }
+  };
+}
+
+std::unique_ptr<GrpcNodeMessageBackend> GrpcNodeMessageBackend::Create
+  ( const std::string& name
+  )
+{
+  if(name == "google-protobuf") {
+    return std::unique_ptr<GrpcNodeMessageBackend>(new GoogleProtobufBackend());
+  }
+  if(name == "protobufjs") {
+    return std::unique_ptr<GrpcNodeMessageBackend>(new ProtobufjsBackend());
+  }
+  return nullptr;
+}
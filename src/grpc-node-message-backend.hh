@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/printer.h>
+
+// Decides how generated code reaches the message classes of a JS protobuf
+// runtime: which module holds the messages of a .proto, how their types are
+// named, and how the transformers, offload workers and bench builders encode
+// and decode them. Selected with the `serializer` generator option.
+class GrpcNodeMessageBackend {
+public:
+
+  virtual ~GrpcNodeMessageBackend() = default;
+
+  // Returns the backend registered under `name`, or nullptr
+  static std::unique_ptr<GrpcNodeMessageBackend> Create
+    ( const std::string& name
+    );
+
+  // Name accepted by the `serializer` option
+  virtual std::string Name
+    () const = 0;
+
+  // Module holding the messages of `protoFilename`, relative to the output
+  // root and without extension
+  virtual std::string ModuleFilename
+    ( const std::string& protoFilename
+    ) const = 0;
+
+  // Identifier the module of `protoFilename` is imported as
+  virtual std::string ModuleAlias
+    ( const std::string& protoFilename
+    ) const = 0;
+
+  // Type and value path of the message class, through its module alias
+  virtual std::string TypePath
+    ( const google::protobuf::Descriptor* descriptor
+    ) const = 0;
+
+  // Body of serialize_<id>(arg) returning a Buffer
+  virtual void PrintSerializerBody
+    ( google::protobuf::io::Printer&  printer
+    , const std::string&              typePath
+    ) const = 0;
+
+  // Body of deserialize_<id>(buffer_arg) returning a message
+  virtual void PrintDeserializerBody
+    ( google::protobuf::io::Printer&  printer
+    , const std::string&              typePath
+    ) const = 0;
+
+  // Expression turning the decoded `message` into a value that survives
+  // postMessage, and the expression rebuilding the message from it
+  virtual std::string CloneableExpression
+    ( const std::string&  typePath
+    , const std::string&  message
+    ) const = 0;
+
+  virtual std::string FromCloneableExpression
+    ( const std::string&  typePath
+    , const std::string&  value
+    ) const = 0;
+
+  // Expression for a new message sharing the field values of `message`, so
+  // that setting a field of the copy leaves `message` alone
+  virtual std::string ShallowCopyExpression
+    ( const std::string&  typePath
+    , const std::string&  message
+    ) const = 0;
+
+  // Expression reading `field` of `message`: a Uint8Array for bytes, an
+  // array for repeated fields
+  virtual std::string GetFieldExpression
+    ( const google::protobuf::FieldDescriptor*  field
+    , const std::string&                        message
+    ) const = 0;
+
+  // Expression for the encoded size of `message`, without naming its type
+  virtual std::string EncodedSizeExpression
+    ( const std::string& message
+    ) const = 0;
+
+  // Statements setting a singular, repeated or map `field` of `message`
+  virtual std::string SetFieldStatement
+    ( const google::protobuf::FieldDescriptor*  field
+    , const std::string&                        message
+    , const std::string&                        value
+    ) const = 0;
+
+  virtual std::string SetRepeatedFieldStatement
+    ( const google::protobuf::FieldDescriptor*  field
+    , const std::string&                        message
+    , const std::string&                        values
+    ) const = 0;
+
+  virtual std::string SetMapEntryStatement
+    ( const google::protobuf::FieldDescriptor*  field
+    , const std::string&                        message
+    , const std::string&                        key
+    , const std::string&                        value
+    ) const = 0;
+};
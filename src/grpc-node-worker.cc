@@ -0,0 +1,236 @@
+#include "grpc-node-worker.hh"
+
+#include "grpc-node-generator-utils.hh"
+
+#include <iostream>
+#include <vector>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+using google::protobuf::DescriptorPool;
+using google::protobuf::FileDescriptor;
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::compiler::CodeGenerator;
+using google::protobuf::compiler::CodeGeneratorRequest;
+using google::protobuf::compiler::CodeGeneratorResponse;
+using google::protobuf::compiler::GeneratorContext;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+using google::protobuf::io::ZeroCopyOutputStream;
+
+namespace utils = GrpcNodeGeneratorUtils;
+
+namespace {
+  // Collects generated files straight into a CodeGeneratorResponse.
+  class ResponseGeneratorContext : public GeneratorContext {
+  private:
+    CodeGeneratorResponse* response_;
+    const std::vector<const FileDescriptor*>& parsedFiles_;
+
+  public:
+    ResponseGeneratorContext
+      ( CodeGeneratorResponse*                     response
+      , const std::vector<const FileDescriptor*>&  parsedFiles
+      )
+      : response_(response)
+      , parsedFiles_(parsedFiles)
+    {
+    }
+
+    ZeroCopyOutputStream* Open
+      ( const std::string& filename
+      ) override
+    {
+      auto file = response_->add_file();
+      file->set_name(filename);
+      return new StringOutputStream(file->mutable_content());
+    }
+
+    ZeroCopyOutputStream* OpenForInsert
+      ( const std::string& filename
+      , const std::string& insertionPoint
+      ) override
+    {
+      auto file = response_->add_file();
+      file->set_name(filename);
+      file->set_insertion_point(insertionPoint);
+      return new StringOutputStream(file->mutable_content());
+    }
+
+    void ListParsedFiles
+      ( std::vector<const FileDescriptor*>* output
+      ) override
+    {
+      *output = parsedFiles_;
+    }
+  };
+}
+
+bool GrpcNodeWorker::IsWellKnownFile
+  ( const std::string& filename
+  )
+{
+  std::string name = filename;
+  return utils::stripPrefix(&name, "google/protobuf/");
+}
+
+GrpcNodeWorker::GrpcNodeWorker
+  ( const CodeGenerator* generator
+  )
+  : generator_(generator)
+  , wellKnownPool_(new DescriptorPool())
+  , requestCount_(0)
+{
+}
+
+bool GrpcNodeWorker::WarmWellKnownPool
+  ( const CodeGeneratorRequest& request
+  )
+{
+  bool stale = false;
+  std::vector<const FileDescriptorProto*> missing;
+
+  for(const auto& proto : request.proto_file()) {
+    if(!IsWellKnownFile(proto.name())) {
+      continue;
+    }
+
+    auto cached = wellKnownFiles_.find(proto.name());
+    if(cached == wellKnownFiles_.end()) {
+      missing.push_back(&proto);
+    } else
+    if(cached->second != proto.SerializeAsString()) {
+      stale = true;
+    }
+  }
+
+  if(stale) {
+    wellKnownPool_.reset(new DescriptorPool());
+    wellKnownFiles_.clear();
+    missing.clear();
+    for(const auto& proto : request.proto_file()) {
+      if(IsWellKnownFile(proto.name())) {
+        missing.push_back(&proto);
+      }
+    }
+  }
+
+  // proto_file is topologically ordered, so dependencies are built first.
+  for(auto proto : missing) {
+    if(wellKnownPool_->BuildFile(*proto) == nullptr) {
+      return false;
+    }
+    wellKnownFiles_[proto->name()] = proto->SerializeAsString();
+  }
+
+  return true;
+}
+
+bool GrpcNodeWorker::HandleRequest
+  ( const CodeGeneratorRequest&  request
+  , CodeGeneratorResponse*       response
+  , std::string*                 error
+  )
+{
+  if(!WarmWellKnownPool(request)) {
+    *error = "failed to build well-known type descriptors";
+    return false;
+  }
+
+  DescriptorPool pool(wellKnownPool_.get());
+  std::vector<const FileDescriptor*> parsedFiles;
+
+  for(const auto& proto : request.proto_file()) {
+    if(IsWellKnownFile(proto.name())) {
+      continue;
+    }
+
+    if(pool.BuildFile(proto) == nullptr) {
+      *error = "failed to build descriptor for " + proto.name();
+      return false;
+    }
+  }
+
+  for(const auto& filename : request.file_to_generate()) {
+    auto file = pool.FindFileByName(filename);
+    if(file == nullptr) {
+      *error = filename + ": file_to_generate not found in proto_file";
+      return false;
+    }
+    parsedFiles.push_back(file);
+  }
+
+  ResponseGeneratorContext context(response, parsedFiles);
+  std::string generatorError;
+  if(!generator_->GenerateAll(
+      parsedFiles, request.parameter(), &context, &generatorError)) {
+    response->clear_file();
+    response->set_error(generatorError);
+  }
+
+  return true;
+}
+
+int GrpcNodeWorker::Run
+  ( ZeroCopyInputStream*   input
+  , ZeroCopyOutputStream*  output
+  )
+{
+  for(;;) {
+    CodeGeneratorRequest request;
+    {
+      CodedInputStream codedInput(input);
+      uint32_t size = 0;
+      if(!codedInput.ReadVarint32(&size)) {
+        // Clean EOF between requests.
+        return 0;
+      }
+
+      auto limit = codedInput.PushLimit(size);
+      if(!request.ParseFromCodedStream(&codedInput) ||
+         !codedInput.ConsumedEntireMessage()) {
+        std::cerr << "protoc-gen-grpc-node: malformed CodeGeneratorRequest"
+                  << std::endl;
+        return 1;
+      }
+      codedInput.PopLimit(limit);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    CodeGeneratorResponse response;
+    std::string error;
+    if(!HandleRequest(request, &response, &error)) {
+      response.Clear();
+      response.set_error(error);
+    }
+
+    {
+      CodedOutputStream codedOutput(output);
+      codedOutput.WriteVarint32(response.ByteSizeLong());
+      response.SerializeWithCachedSizes(&codedOutput);
+      if(codedOutput.HadError()) {
+        std::cerr << "protoc-gen-grpc-node: failed to write response"
+                  << std::endl;
+        return 1;
+      }
+    }
+
+    auto fileOutput =
+      dynamic_cast<google::protobuf::io::FileOutputStream*>(output);
+    if(fileOutput != nullptr) {
+      fileOutput->Flush();
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    ++requestCount_;
+    std::cerr << "protoc-gen-grpc-node: request " << requestCount_
+              << " (" << request.file_to_generate_size() << " files) took "
+              << elapsed.count() << "ms" << std::endl;
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <google/protobuf/compiler/code_generator.h>
+#include <google/protobuf/compiler/plugin.pb.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+
+// Long-lived plugin mode. Instead of handling a single CodeGeneratorRequest
+// and exiting (PluginMain), the worker reads a stream of varint
+// length-prefixed CodeGeneratorRequests from `input` and answers each with a
+// varint length-prefixed CodeGeneratorResponse on `output`, until EOF.
+//
+// Descriptors for well-known types (google/protobuf/*.proto) are built once
+// and shared as an underlay of every per-request pool, so only the request's
+// own files are cross-linked each time.
+class GrpcNodeWorker {
+private:
+  const google::protobuf::compiler::CodeGenerator* generator_;
+  std::unique_ptr<google::protobuf::DescriptorPool> wellKnownPool_;
+  std::map<std::string, std::string> wellKnownFiles_;
+  int requestCount_;
+
+  // Makes sure every well-known file in `request` is present in
+  // wellKnownPool_, rebuilding the pool if a cached file differs.
+  bool WarmWellKnownPool
+    ( const google::protobuf::compiler::CodeGeneratorRequest& request
+    );
+
+public:
+
+  static bool IsWellKnownFile
+    ( const std::string& filename
+    );
+
+  GrpcNodeWorker
+    ( const google::protobuf::compiler::CodeGenerator* generator
+    );
+
+  // Runs a single request. Errors are reported through response->error() the
+  // same way PluginMain does; false is only returned if the request could not
+  // be handled at all.
+  bool HandleRequest
+    ( const google::protobuf::compiler::CodeGeneratorRequest&  request
+    , google::protobuf::compiler::CodeGeneratorResponse*       response
+    , std::string*                                             error
+    );
+
+  // Serves requests until `input` is exhausted. Per-request latency is
+  // reported on stderr. Returns the process exit code.
+  int Run
+    ( google::protobuf::io::ZeroCopyInputStream*   input
+    , google::protobuf::io::ZeroCopyOutputStream*  output
+    );
+};
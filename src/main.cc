@@ -1,9 +1,28 @@
+#include <cstring>
 #include <google/protobuf/compiler/plugin.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
 
 #include "grpc-node-generator.hh"
+#include "grpc-node-worker.hh"
+
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::FileOutputStream;
+
+namespace {
+  const int kStdinFd = 0;
+  const int kStdoutFd = 1;
+}
 
 int main(int argc, char* argv[]) {
   GrpcNodeGenerator generator;
+
+  if(argc == 2 && std::strcmp(argv[1], "--worker") == 0) {
+    FileInputStream input(kStdinFd);
+    FileOutputStream output(kStdoutFd);
+    GrpcNodeWorker worker(&generator);
+    return worker.Run(&input, &output);
+  }
+
   PluginMain(argc, argv, &generator);
   return 0;
 }
@@ -0,0 +1,96 @@
+// Runs the admission wrapper generated for test/protos/admission.proto
+// (admission_control option) against stand-ins for grpc and the message
+// module: a cancelled server stream whose handler never ends it must give
+// its slot back.
+//
+// Usage: node admission_test.js <admission_grpc_pb.ts>
+//
+// Uses the typescript package when it can be resolved (NODE_PATH), else the
+// type stripper built into Node.js 22.13 and later.
+'use strict';
+
+const assert = require('assert');
+const { EventEmitter } = require('events');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const url = require('url');
+
+function transpile(source) {
+  let ts;
+  try {
+    ts = require('typescript');
+  } catch (e) {
+    const { stripTypeScriptTypes } = require('module');
+    return stripTypeScriptTypes(source, { mode: 'transform' });
+  }
+  return ts.transpileModule(source, {
+    compilerOptions: {
+      module: ts.ModuleKind.ESNext,
+      target: ts.ScriptTarget.ES2019,
+    },
+  }).outputText;
+}
+
+// Just enough of the grpc package to load the generated module.
+const GRPC_STUB = `
+exports.Metadata = class Metadata {};
+exports.status = { RESOURCE_EXHAUSTED: 8 };
+exports.makeGenericClientConstructor = () => class {};
+`;
+
+async function main() {
+  const work = fs.mkdtempSync(path.join(os.tmpdir(), 'admission_test'));
+  try {
+    fs.mkdirSync(path.join(work, 'node_modules', 'grpc'), { recursive: true });
+    fs.writeFileSync(path.join(work, 'node_modules', 'grpc', 'index.js'),
+                     GRPC_STUB);
+    fs.writeFileSync(path.join(work, 'admission_pb.cjs'),
+                     'exports.Tick = class Tick {};\n');
+    const source = transpile(fs.readFileSync(process.argv[2], 'utf8'))
+      .replace(/from '\.\/admission_pb'/, "from './admission_pb.cjs'");
+    const modulePath = path.join(work, 'admission_grpc_pb.mjs');
+    fs.writeFileSync(modulePath, source);
+    const generated = await import(url.pathToFileURL(modulePath).href);
+
+    let started = 0;
+    const implementation = generated.admitClockImplementation({
+      // Never ends the stream, even once it is cancelled.
+      watch: () => started++,
+    });
+
+    const call = () => {
+      const stream = new EventEmitter();
+      stream.errors = [];
+      stream.on('error', (error) => stream.errors.push(error.code));
+      implementation.watch(stream);
+      return stream;
+    };
+
+    const first = call();
+    assert.strictEqual(started, 1);
+
+    // max_concurrent_calls is 1 and nothing may queue.
+    const shed = call();
+    assert.strictEqual(started, 1);
+    assert.deepStrictEqual(shed.errors, [8]);
+
+    first.emit('cancelled');
+    const next = call();
+    assert.strictEqual(started, 2, 'cancelled stream kept its slot');
+    assert.deepStrictEqual(next.errors, []);
+
+    // Finishing after the cancellation does not free a second slot.
+    first.emit('finish');
+    call();
+    assert.strictEqual(started, 2);
+  } finally {
+    fs.rmSync(work, { recursive: true, force: true });
+  }
+  console.log('admission_test: ok');
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -0,0 +1,59 @@
+// Checks that generated TypeScript files parse.
+//
+// Usage: node check_syntax.js <file.ts>...
+//
+// Uses the typescript package when it can be resolved (NODE_PATH), else the
+// type stripper built into Node.js 22.13 and later. Only syntax is checked:
+// the generated files import message modules the tests do not build.
+'use strict';
+
+const fs = require('fs');
+
+function typescriptChecker() {
+  let ts;
+  try {
+    ts = require('typescript');
+  } catch (e) {
+    return undefined;
+  }
+  return (source, file) => {
+    const output = ts.transpileModule(source, {
+      fileName: file,
+      reportDiagnostics: true,
+    });
+    return output.diagnostics.map(
+      (diagnostic) => ts.flattenDiagnosticMessageText(diagnostic.messageText,
+                                                      '\n'));
+  };
+}
+
+function stripTypesChecker() {
+  const { stripTypeScriptTypes } = require('module');
+  if (stripTypeScriptTypes === undefined) {
+    return undefined;
+  }
+  return (source) => {
+    try {
+      stripTypeScriptTypes(source, { mode: 'transform' });
+      return [];
+    } catch (e) {
+      return [e.message];
+    }
+  };
+}
+
+const check = typescriptChecker() || stripTypesChecker();
+if (check === undefined) {
+  console.error('check_syntax: needs the typescript package on NODE_PATH ' +
+                'or Node.js 22.13 or later');
+  process.exit(2);
+}
+
+let failed = false;
+for (const file of process.argv.slice(2)) {
+  for (const error of check(fs.readFileSync(file, 'utf8'), file)) {
+    console.error(`${file}: ${error}`);
+    failed = true;
+  }
+}
+process.exit(failed ? 1 : 0);
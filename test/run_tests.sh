@@ -0,0 +1,184 @@
+#!/bin/sh
+# Generator tests, run with
+#
+#   bazel test //:generator_test
+#
+# Runs protoc-gen-grpc-node over test/protos, checks that the generated
+# TypeScript parses (check_syntax.js) and that bad input fails generation
+# with the expected error, runs the generated admission wrapper
+# (admission_test.js) and drives the persistent worker (worker_test.js).
+#
+# Nothing is fetched. check_syntax.js and admission_test.js use typescript
+# from --node_modules when it is there, else need Node.js 22.13 or later.
+#
+# Options:
+#   --protoc=<protoc>
+#   --plugin=<protoc-gen-grpc-node>
+#   --node_modules=<dir>        default: none
+#   <google/protobuf/*.proto>   well-known protos for grpc_node/options.proto
+#                               when protoc does not bundle them
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+protos="$here/protos"
+node_modules=""
+well_known=""
+
+absolute() {
+  case "$1" in
+    /*) echo "$1" ;;
+    *) echo "$2/$1" ;;
+  esac
+}
+
+for arg in "$@"; do
+  value="${arg#*=}"
+  case "$arg" in
+    --protoc=*) protoc=$(absolute "$value" "$(pwd)") ;;
+    --plugin=*) plugin=$(absolute "$value" "$(pwd)") ;;
+    --node_modules=*) node_modules=$(absolute "$value" "$(pwd)") ;;
+    */google/protobuf/*.proto)
+      well_known="-I$(absolute "${arg%google/protobuf/*}" "$(pwd)")" ;;
+    *) echo "generator_test: unknown option $arg" >&2; exit 2 ;;
+  esac
+done
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=0
+
+fail() {
+  echo "FAIL: $*" >&2
+  failures=$((failures + 1))
+}
+
+# run_protoc <out> <parameter> <proto>...
+run_protoc() {
+  out="$1"
+  parameter="$2"
+  shift 2
+  rm -rf "$out"
+  mkdir -p "$out"
+  "$protoc" -I"$protos" -I"$here/../proto" $well_known \
+    --plugin=protoc-gen-grpc-node="$plugin" \
+    --grpc-node_out="$parameter:$out" "$@"
+}
+
+# expect_generates <parameter> <proto>...: generation succeeds and every
+# generated .ts file parses.
+expect_generates() {
+  parameter="$1"
+  shift
+  out="$work/out"
+  if ! run_protoc "$out" "$parameter" "$@" 2> "$work/stderr"; then
+    fail "'$parameter' $*: $(cat "$work/stderr")"
+    return
+  fi
+  if ! NODE_PATH="$node_modules" node "$here/check_syntax.js" \
+       $(find "$out" -name '*.ts'); then
+    fail "'$parameter' $*: generated TypeScript does not parse"
+  fi
+}
+
+# expect_json <parameter> <proto>...: every generated .json file parses.
+expect_json() {
+  parameter="$1"
+  shift
+  out="$work/out"
+  if ! run_protoc "$out" "$parameter" "$@" 2> "$work/stderr"; then
+    fail "'$parameter' $*: $(cat "$work/stderr")"
+    return
+  fi
+  for report in $(find "$out" -name '*.json'); do
+    node -e 'JSON.parse(require("fs").readFileSync(process.argv[1], "utf8"))' \
+      "$report" || fail "'$parameter' $*: $report is not JSON"
+  done
+}
+
+# expect_error <parameter> <message> <proto>...: generation fails and
+# protoc reports <message>.
+expect_error() {
+  parameter="$1"
+  message="$2"
+  shift 2
+  if run_protoc "$work/out" "$parameter" "$@" 2> "$work/stderr"; then
+    fail "'$parameter' $*: expected error: $message"
+  elif ! grep -qF -- "$message" "$work/stderr"; then
+    fail "'$parameter' $*: expected error: $message, got: $(cat "$work/stderr")"
+  fi
+}
+
+expect_generates "" greeter.proto
+expect_generates "target=grpc-js" greeter.proto
+
+# Every option on its own and all of them together, for a method named New.
+all=""
+for option in split_services caching_client pooled_client bench in_process \
+    passthrough offload_deserialize=new_method.Blob async_streaming \
+    policy_report size_report deadline_propagation admission_control \
+    target=grpc-js serializer=protobufjs; do
+  expect_generates "$option" new_method.proto
+  all="${all:+$all,}$option"
+done
+expect_generates "$all" new_method.proto
+
+# Service config policies, see GetServiceConfigPolicy.
+expect_generates "" policy/service_config.proto
+expect_json "policy_report,size_report" policy/service_config.proto \
+  greeter.proto
+expect_error "" \
+  "policy.Store.Put: hedging_policy requires idempotency_level IDEMPOTENT or NO_SIDE_EFFECTS" \
+  policy/hedging_unknown_idempotency.proto
+expect_error "" \
+  "policy.Store.Get: retry_policy and hedging_policy are mutually exclusive" \
+  policy/retry_and_hedging.proto
+expect_error "" \
+  "policy.Store.Put: retry_policy.max_attempts must be at least 2" \
+  policy/retry_max_attempts.proto
+expect_error "" \
+  "policy.Store.Get: hedging_policy.max_attempts must be at least 2" \
+  policy/hedging_max_attempts.proto
+
+# Option validation, see grpc-node-generator-options.cc.
+expect_error "no_such_option" \
+  "Unknown generator option: no_such_option" greeter.proto
+expect_error "target=grpc-web" \
+  "Unknown target: grpc-web (expected grpc or grpc-js)" greeter.proto
+expect_error "serializer=json" \
+  "Unknown serializer: json (expected google-protobuf or protobufjs)" \
+  greeter.proto
+expect_error "offload_threshold=1k" \
+  "offload_threshold must be a number of bytes" greeter.proto
+expect_error "offload_threshold=-1" \
+  "offload_threshold must be a number of bytes" greeter.proto
+# One past Number.MAX_SAFE_INTEGER, and one past 2^64.
+expect_error "offload_threshold=9007199254740992" \
+  "offload_threshold must be a number of bytes" greeter.proto
+expect_error "deadline_margin_ms=18446744073709551616" \
+  "deadline_margin_ms must be a number of milliseconds" greeter.proto
+expect_error "stream_window=0" \
+  "stream_window must be a positive number of messages" greeter.proto
+expect_error "size_report_top=" \
+  "size_report_top must be a number of protos" greeter.proto
+expect_error "offload_deserialize=greeter.NoSuchType" \
+  "offload_deserialize: greeter.NoSuchType is not a request or response type of any service" \
+  greeter.proto
+expect_generates "offload_threshold=9007199254740991" greeter.proto
+
+# Admission slots of cancelled calls, see admission_test.js.
+if run_protoc "$work/admission" "admission_control" admission.proto \
+     2> "$work/stderr"; then
+  NODE_PATH="$node_modules" node "$here/admission_test.js" \
+    "$work/admission/admission_grpc_pb.ts" || fail "admission_test.js"
+else
+  fail "'admission_control' admission.proto: $(cat "$work/stderr")"
+fi
+
+node "$here/worker_test.js" --protoc="$protoc" --plugin="$plugin" ||
+  fail "worker_test.js"
+
+if [ "$failures" -ne 0 ]; then
+  echo "generator_test: $failures failed" >&2
+  exit 1
+fi
+echo "generator_test: ok"
@@ -0,0 +1,191 @@
+// Drives `protoc-gen-grpc-node --worker` with two length-prefixed
+// CodeGeneratorRequests. The second request changes a well-known file, so
+// its response only has the new message if the worker rebuilt its cached
+// well-known pool instead of reusing the stale one.
+//
+// Usage: node worker_test.js --protoc=<protoc> --plugin=<plugin>
+'use strict';
+
+const assert = require('assert');
+const childProcess = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const args = {};
+for (const arg of process.argv.slice(2)) {
+  const match = /^--([^=]+)=(.*)$/.exec(arg);
+  if (!match) {
+    throw new Error(`worker_test: unknown argument ${arg}`);
+  }
+  args[match[1]] = match[2];
+}
+
+function varint(value) {
+  const bytes = [];
+  while (value > 0x7f) {
+    bytes.push((value & 0x7f) | 0x80);
+    value >>>= 7;
+  }
+  bytes.push(value);
+  return Buffer.from(bytes);
+}
+
+function lengthDelimited(field, payload) {
+  return Buffer.concat([varint((field << 3) | 2), varint(payload.length),
+                        payload]);
+}
+
+// Reads every field of a message as [field, wireType, value] triples.
+// Length-delimited values are left as Buffers.
+function decode(buffer) {
+  const fields = [];
+  let offset = 0;
+  const readVarint = () => {
+    let value = 0;
+    let shift = 0;
+    for (;;) {
+      const byte = buffer[offset++];
+      value += (byte & 0x7f) * 2 ** shift;
+      if (byte < 0x80) {
+        return value;
+      }
+      shift += 7;
+    }
+  };
+  while (offset < buffer.length) {
+    const tag = readVarint();
+    const wireType = tag & 7;
+    let value;
+    if (wireType === 0) {
+      value = readVarint();
+    } else if (wireType === 2) {
+      const length = readVarint();
+      value = buffer.subarray(offset, offset + length);
+      offset += length;
+    } else {
+      throw new Error(`worker_test: unexpected wire type ${wireType}`);
+    }
+    fields.push([tag >>> 3, wireType, value]);
+  }
+  return fields;
+}
+
+// FileDescriptorSet.file (1) and CodeGeneratorRequest.proto_file (15) hold
+// the same FileDescriptorProtos in the same dependency order.
+function buildRequest(descriptorSet, fileToGenerate, parameter) {
+  const parts = [
+    lengthDelimited(1, Buffer.from(fileToGenerate)),
+    lengthDelimited(2, Buffer.from(parameter)),
+  ];
+  for (const [field, , value] of decode(descriptorSet)) {
+    assert.strictEqual(field, 1);
+    parts.push(lengthDelimited(15, value));
+  }
+  return Buffer.concat(parts);
+}
+
+function parseResponse(buffer) {
+  const response = { error: undefined, files: {} };
+  for (const [field, , value] of decode(buffer)) {
+    if (field === 1) {
+      response.error = value.toString();
+    } else if (field === 15) {
+      let name;
+      let content;
+      for (const [fileField, , fileValue] of decode(value)) {
+        if (fileField === 1) {
+          name = fileValue.toString();
+        } else if (fileField === 15) {
+          content = fileValue.toString();
+        }
+      }
+      response.files[name] = content;
+    }
+  }
+  return response;
+}
+
+function splitFrames(buffer) {
+  const frames = [];
+  let offset = 0;
+  while (offset < buffer.length) {
+    let length = 0;
+    let shift = 0;
+    let byte;
+    do {
+      byte = buffer[offset++];
+      length |= (byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    frames.push(buffer.subarray(offset, offset + length));
+    offset += length;
+  }
+  return frames;
+}
+
+const work = fs.mkdtempSync(path.join(os.tmpdir(), 'worker_test'));
+const probePath = path.join(work, 'google', 'protobuf', 'worker_probe.proto');
+fs.mkdirSync(path.dirname(probePath), { recursive: true });
+
+function descriptorSet(probeSource, responseType) {
+  fs.writeFileSync(probePath, probeSource);
+  fs.writeFileSync(path.join(work, 'probe.proto'), `
+syntax = "proto3";
+package probe;
+import "google/protobuf/worker_probe.proto";
+service Probe {
+  rpc Get(google.protobuf.WorkerProbe) returns (google.protobuf.${responseType});
+}
+`);
+  const out = path.join(work, 'set.pb');
+  childProcess.execFileSync(args.protoc, [
+    `-I${work}`, '--include_imports', `--descriptor_set_out=${out}`,
+    'probe.proto',
+  ]);
+  return fs.readFileSync(out);
+}
+
+const first = descriptorSet(`
+syntax = "proto3";
+package google.protobuf;
+message WorkerProbe { string first = 1; }
+`, 'WorkerProbe');
+// Same file name, new contents: probe.proto only links if the worker drops
+// the cached build of the first version.
+const second = descriptorSet(`
+syntax = "proto3";
+package google.protobuf;
+message WorkerProbe { string first = 1; }
+message WorkerProbeReply { string second = 1; }
+`, 'WorkerProbeReply');
+
+const input = Buffer.concat([first, second].map((set) => {
+  const request = buildRequest(set, 'probe.proto', '');
+  return Buffer.concat([varint(request.length), request]);
+}));
+
+const result = childProcess.spawnSync(args.plugin, ['--worker'], { input });
+if (result.error) {
+  throw result.error;
+}
+fs.rmSync(work, { recursive: true, force: true });
+
+const stderr = result.stderr.toString();
+assert.strictEqual(result.status, 0,
+                   `worker exited with ${result.status}:\n${stderr}`);
+assert.match(stderr, /request 1 \(1 files\)/);
+assert.match(stderr, /request 2 \(1 files\)/);
+
+const responses = splitFrames(result.stdout).map(parseResponse);
+assert.strictEqual(responses.length, 2);
+for (const response of responses) {
+  assert.strictEqual(response.error, undefined);
+  assert.deepStrictEqual(Object.keys(response.files), ['probe_grpc_pb.ts']);
+}
+
+const reply = 'google__protobuf__worker_probe_pb.WorkerProbeReply';
+assert.ok(!responses[0].files['probe_grpc_pb.ts'].includes(reply));
+assert.ok(responses[1].files['probe_grpc_pb.ts'].includes(reply));
+
+console.log('worker_test: ok');